@@ -0,0 +1,270 @@
+
+/*
+   Batch AHRS Filter Implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ahrs_batch.h"
+#include "madgwick_ahrs.h"
+#include "mahony_ahrs.h"
+
+
+/* instruction set specific kernels, each updates as many instances as fit
+   into whole vectors and returns their number; the rest is done in scalar code,
+   which does all instances where a kernel is NULL: */
+typedef struct
+{
+   const char *name;
+   size_t (*madgwick)(madgwick_ahrs_batch_t *batch, const ahrs_batch_in_t *in, float accelCutoff);
+   size_t (*mahony)(mahony_ahrs_batch_t *batch, const ahrs_batch_in_t *in);
+}
+isa_t;
+
+
+static const isa_t isa_scalar = {"scalar", NULL, NULL};
+
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+
+typedef float vf4_t __attribute__((vector_size(16)));
+typedef int vi4_t __attribute__((vector_size(16)));
+typedef unsigned int vu4_t __attribute__((vector_size(16)));
+
+#define LANES 4
+#define TARGET __attribute__((target("sse2")))
+#define KERNEL(name) name ## _sse2
+#define vf_t vf4_t
+#define vi_t vi4_t
+#define vu_t vu4_t
+#define vf_sqrt(x) ((vf4_t)_mm_sqrt_ps((__m128)(x)))
+#include "ahrs_batch_kernel.h"
+#undef LANES
+#undef TARGET
+#undef KERNEL
+#undef vf_t
+#undef vi_t
+#undef vu_t
+#undef vf_sqrt
+
+
+typedef float vf8_t __attribute__((vector_size(32)));
+typedef int vi8_t __attribute__((vector_size(32)));
+typedef unsigned int vu8_t __attribute__((vector_size(32)));
+
+/* without fma, so the lanes round like the scalar code: */
+#define LANES 8
+#define TARGET __attribute__((target("avx2")))
+#define KERNEL(name) name ## _avx2
+#define vf_t vf8_t
+#define vi_t vi8_t
+#define vu_t vu8_t
+#define vf_sqrt(x) ((vf8_t)_mm256_sqrt_ps((__m256)(x)))
+#include "ahrs_batch_kernel.h"
+#undef LANES
+#undef TARGET
+#undef KERNEL
+#undef vf_t
+#undef vi_t
+#undef vu_t
+#undef vf_sqrt
+
+
+static const isa_t isa_sse2 = {"sse2", madgwick_batch_sse2, mahony_batch_sse2};
+static const isa_t isa_avx2 = {"avx2", madgwick_batch_avx2, mahony_batch_avx2};
+
+
+static const isa_t *isa_detect(void)
+{
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+   {
+      return &isa_avx2;
+   }
+   if (__builtin_cpu_supports("sse2"))
+   {
+      return &isa_sse2;
+   }
+   return &isa_scalar;
+}
+
+#else
+
+static const isa_t *isa_detect(void)
+{
+   return &isa_scalar;
+}
+
+#endif
+
+
+static const isa_t *isa_get(void)
+{
+   static const isa_t *isa = NULL;
+   const isa_t *ret = __atomic_load_n(&isa, __ATOMIC_ACQUIRE);
+   if (ret == NULL)
+   {
+      ret = isa_detect();
+      __atomic_store_n(&isa, ret, __ATOMIC_RELEASE);
+   }
+   return ret;
+}
+
+
+const char *ahrs_batch_isa(void)
+{
+   return isa_get()->name;
+}
+
+
+/* allocates count arrays of n floats from one block: */
+static float *alloc_arrays(float **arrays[], size_t count, size_t n)
+{
+   float *block = calloc(count * n + 1, sizeof(float));
+   if (block != NULL)
+   {
+      size_t i;
+      for (i = 0; i < count; i++)
+      {
+         *arrays[i] = block + i * n;
+      }
+   }
+   return block;
+}
+
+
+int madgwick_ahrs_batch_init(madgwick_ahrs_batch_t *batch, size_t n, float beta)
+{
+   float **arrays[] = {&batch->beta, &batch->q0, &batch->q1, &batch->q2, &batch->q3};
+   batch->n = n;
+   if (alloc_arrays(arrays, sizeof(arrays) / sizeof(arrays[0]), n) == NULL)
+   {
+      return -ENOMEM;
+   }
+   size_t i;
+   for (i = 0; i < n; i++)
+   {
+      batch->beta[i] = beta;
+      batch->q0[i] = 1.0f;
+   }
+   return 0;
+}
+
+
+void madgwick_ahrs_batch_free(madgwick_ahrs_batch_t *batch)
+{
+   free(batch->beta); /* first array of the block */
+   batch->n = 0;
+}
+
+
+void madgwick_ahrs_batch_get(const madgwick_ahrs_batch_t *batch, size_t i, quat_t *quat)
+{
+   quat->q0 = batch->q0[i];
+   quat->q1 = batch->q1[i];
+   quat->q2 = batch->q2[i];
+   quat->q3 = batch->q3[i];
+}
+
+
+void madgwick_ahrs_batch_update(madgwick_ahrs_batch_t *batch, const ahrs_batch_in_t *in, float accelCutoff)
+{
+   const isa_t *isa = isa_get();
+   size_t i = isa->madgwick ? isa->madgwick(batch, in, accelCutoff) : 0;
+   for (; i < batch->n; i++)
+   {
+      madgwick_ahrs_t ahrs;
+      ahrs.beta = batch->beta[i];
+      madgwick_ahrs_batch_get(batch, i, &ahrs.quat);
+      madgwick_ahrs_update(&ahrs, in->gx[i], in->gy[i], in->gz[i],
+                           in->ax[i], in->ay[i], in->az[i],
+                           in->mx[i], in->my[i], in->mz[i],
+                           accelCutoff, in->dt[i]);
+      batch->q0[i] = ahrs.quat.q0;
+      batch->q1[i] = ahrs.quat.q1;
+      batch->q2[i] = ahrs.quat.q2;
+      batch->q3[i] = ahrs.quat.q3;
+   }
+}
+
+
+int mahony_ahrs_batch_init(mahony_ahrs_batch_t *batch, size_t n, float Kp, float Ki)
+{
+   float **arrays[] = {&batch->twoKp, &batch->twoKi, &batch->integralFBx, &batch->integralFBy,
+                       &batch->integralFBz, &batch->q0, &batch->q1, &batch->q2, &batch->q3};
+   batch->n = n;
+   if (alloc_arrays(arrays, sizeof(arrays) / sizeof(arrays[0]), n) == NULL)
+   {
+      return -ENOMEM;
+   }
+   size_t i;
+   for (i = 0; i < n; i++)
+   {
+      batch->twoKp[i] = Kp * 2.0f;
+      batch->twoKi[i] = Ki * 2.0f;
+      batch->q0[i] = 1.0f;
+   }
+   return 0;
+}
+
+
+void mahony_ahrs_batch_free(mahony_ahrs_batch_t *batch)
+{
+   free(batch->twoKp); /* first array of the block */
+   batch->n = 0;
+}
+
+
+void mahony_ahrs_batch_get(const mahony_ahrs_batch_t *batch, size_t i, quat_t *quat)
+{
+   quat->q0 = batch->q0[i];
+   quat->q1 = batch->q1[i];
+   quat->q2 = batch->q2[i];
+   quat->q3 = batch->q3[i];
+}
+
+
+void mahony_ahrs_batch_update(mahony_ahrs_batch_t *batch, const ahrs_batch_in_t *in)
+{
+   const isa_t *isa = isa_get();
+   size_t i = isa->mahony ? isa->mahony(batch, in) : 0;
+   for (; i < batch->n; i++)
+   {
+      mahony_ahrs_t ahrs;
+      ahrs.twoKp = batch->twoKp[i];
+      ahrs.twoKi = batch->twoKi[i];
+      ahrs.integralFBx = batch->integralFBx[i];
+      ahrs.integralFBy = batch->integralFBy[i];
+      ahrs.integralFBz = batch->integralFBz[i];
+      mahony_ahrs_batch_get(batch, i, &ahrs.quat);
+      mahony_ahrs_update(&ahrs, in->gx[i], in->gy[i], in->gz[i],
+                         in->ax[i], in->ay[i], in->az[i],
+                         in->mx[i], in->my[i], in->mz[i], in->dt[i]);
+      batch->integralFBx[i] = ahrs.integralFBx;
+      batch->integralFBy[i] = ahrs.integralFBy;
+      batch->integralFBz[i] = ahrs.integralFBz;
+      batch->q0[i] = ahrs.quat.q0;
+      batch->q1[i] = ahrs.quat.q1;
+      batch->q2[i] = ahrs.quat.q2;
+      batch->q3[i] = ahrs.quat.q3;
+   }
+}
+
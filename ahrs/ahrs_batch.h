@@ -0,0 +1,107 @@
+
+/*
+   Batch AHRS Filter Interface
+
+   Updates many independent Madgwick or Mahony filter instances at once,
+   e.g. for parameter sweeps or redundant IMUs. The instances are stored
+   as structure of arrays, so one vector instruction serves 4 (SSE2)
+   or 8 (AVX2) of them; the instruction set is chosen at runtime.
+   Each instance follows the same arithmetic as the scalar filter.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __AHRS_BATCH_H__
+#define __AHRS_BATCH_H__
+
+
+#include <stddef.h>
+
+#include "../util/math.h"
+
+
+/* madgwick filter instances, see madgwick_ahrs_t: */
+typedef struct
+{
+   size_t n;
+   float *beta;
+   float *q0;
+   float *q1;
+   float *q2;
+   float *q3;
+}
+madgwick_ahrs_batch_t;
+
+
+/* mahony filter instances, see mahony_ahrs_t: */
+typedef struct
+{
+   size_t n;
+   float *twoKp;
+   float *twoKi;
+   float *integralFBx;
+   float *integralFBy;
+   float *integralFBz;
+   float *q0;
+   float *q1;
+   float *q2;
+   float *q3;
+}
+mahony_ahrs_batch_t;
+
+
+/* sensor inputs, one array of n values per component: */
+typedef struct
+{
+   const float *gx;
+   const float *gy;
+   const float *gz;
+   const float *ax;
+   const float *ay;
+   const float *az;
+   const float *mx;
+   const float *my;
+   const float *mz;
+   const float *dt;
+}
+ahrs_batch_in_t;
+
+
+/* returns the name of the instruction set used: "avx2", "sse2" or "scalar" */
+const char *ahrs_batch_isa(void);
+
+
+/* allocates n instances with the same gain, which may be changed per instance;
+   returns 0 or -ENOMEM */
+int madgwick_ahrs_batch_init(madgwick_ahrs_batch_t *batch, size_t n, float beta);
+
+void madgwick_ahrs_batch_free(madgwick_ahrs_batch_t *batch);
+
+void madgwick_ahrs_batch_get(const madgwick_ahrs_batch_t *batch, size_t i, quat_t *quat);
+
+/* updates all instances, instance i with the i-th value of each input */
+void madgwick_ahrs_batch_update(madgwick_ahrs_batch_t *batch, const ahrs_batch_in_t *in, float accelCutoff);
+
+
+int mahony_ahrs_batch_init(mahony_ahrs_batch_t *batch, size_t n, float Kp, float Ki);
+
+void mahony_ahrs_batch_free(mahony_ahrs_batch_t *batch);
+
+void mahony_ahrs_batch_get(const mahony_ahrs_batch_t *batch, size_t i, quat_t *quat);
+
+void mahony_ahrs_batch_update(mahony_ahrs_batch_t *batch, const ahrs_batch_in_t *in);
+
+
+#endif /* __AHRS_BATCH_H__ */
+
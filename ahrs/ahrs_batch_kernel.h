@@ -0,0 +1,258 @@
+
+/*
+   Batch AHRS Filter Kernels
+
+   Included by ahrs_batch.c once per instruction set, with:
+   LANES: number of instances per vector
+   TARGET: attribute enabling the instruction set
+   KERNEL(name): name of a function for this instruction set
+   vf_t, vi_t, vu_t: vectors of LANES floats, ints and unsigned ints
+   vf_sqrt(x): square root of a vf_t
+
+   The branches of the scalar filters become masks, so the expressions
+   below must be kept in sync with madgwick_ahrs.c and mahony_ahrs.c;
+   the Madgwick gradients of both are generated by gen_kernels.py.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+static inline TARGET vf_t KERNEL(load)(const float *p)
+{
+   vf_t v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+
+static inline TARGET void KERNEL(store)(float *p, vf_t v)
+{
+   memcpy(p, &v, sizeof(v));
+}
+
+
+/* per lane mask ? a : b */
+static inline TARGET vf_t KERNEL(select)(vi_t mask, vf_t a, vf_t b)
+{
+   return (vf_t)(((vi_t)a & mask) | ((vi_t)b & ~mask));
+}
+
+
+#include "madgwick_batch_kernels.h"
+
+
+/* same approximation as inv_sqrt(): */
+static inline TARGET vf_t KERNEL(inv_sqrt)(vf_t x)
+{
+   vu_t i = 0x5F1F1412 - ((vu_t)x >> 1);
+   vf_t tmp = (vf_t)i;
+   return tmp * (1.69000231f - 0.714158168f * x * tmp * tmp);
+}
+
+
+/* updates the instances in whole vectors, returns the number updated: */
+static TARGET size_t KERNEL(madgwick_batch)(madgwick_ahrs_batch_t *batch, const ahrs_batch_in_t *in, float accelCutoff)
+{
+   size_t i;
+   for (i = 0; i + LANES <= batch->n; i += LANES)
+   {
+      vf_t q0 = KERNEL(load)(&batch->q0[i]);
+      vf_t q1 = KERNEL(load)(&batch->q1[i]);
+      vf_t q2 = KERNEL(load)(&batch->q2[i]);
+      vf_t q3 = KERNEL(load)(&batch->q3[i]);
+      vf_t beta = KERNEL(load)(&batch->beta[i]);
+      vf_t gx = KERNEL(load)(&in->gx[i]);
+      vf_t gy = KERNEL(load)(&in->gy[i]);
+      vf_t gz = KERNEL(load)(&in->gz[i]);
+      vf_t ax = KERNEL(load)(&in->ax[i]);
+      vf_t ay = KERNEL(load)(&in->ay[i]);
+      vf_t az = KERNEL(load)(&in->az[i]);
+      vf_t mx = KERNEL(load)(&in->mx[i]);
+      vf_t my = KERNEL(load)(&in->my[i]);
+      vf_t mz = KERNEL(load)(&in->mz[i]);
+      vf_t dt = KERNEL(load)(&in->dt[i]);
+      vf_t recipNorm;
+
+      /* lanes using the magnetometer and lanes with valid acceleration: */
+      vi_t use_mag = ~((mx == 0.0f) & (my == 0.0f) & (mz == 0.0f));
+      vf_t accelSquareSum = ax * ax + ay * ay + az * az;
+      vf_t accelError = vf_sqrt(accelSquareSum) - 9.8065f;
+      vi_t acc_ok = (accelError < accelCutoff) & (-accelError < accelCutoff);
+
+      /* rate of change of quaternion from gyroscope: */
+      vf_t qDot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+      vf_t qDot1 = 0.5f * ( q0 * gx + q2 * gz - q3 * gy);
+      vf_t qDot2 = 0.5f * ( q0 * gy - q1 * gz + q3 * gx);
+      vf_t qDot3 = 0.5f * ( q0 * gz + q1 * gy - q2 * gx);
+
+      /* normalise accelerometer and magnetometer measurements: */
+      recipNorm = KERNEL(inv_sqrt)(accelSquareSum);
+      ax *= recipNorm;
+      ay *= recipNorm;
+      az *= recipNorm;
+      recipNorm = KERNEL(inv_sqrt)(mx * mx + my * my + mz * mz);
+      mx *= recipNorm;
+      my *= recipNorm;
+      mz *= recipNorm;
+
+      /* IMU and AHRS corrective steps: */
+      vf_t si[4], sm[4];
+      KERNEL(madgwick_gradient_imu)(si, q0, q1, q2, q3, ax, ay, az);
+      recipNorm = KERNEL(inv_sqrt)(si[0] * si[0] + si[1] * si[1] + si[2] * si[2] + si[3] * si[3]);
+      si[0] *= recipNorm;
+      si[1] *= recipNorm;
+      si[2] *= recipNorm;
+      si[3] *= recipNorm;
+      KERNEL(madgwick_gradient_marg)(sm, q0, q1, q2, q3, ax, ay, az, mx, my, mz);
+      recipNorm = KERNEL(inv_sqrt)(sm[0] * sm[0] + sm[1] * sm[1] + sm[2] * sm[2] + sm[3] * sm[3]);
+      sm[0] *= recipNorm;
+      sm[1] *= recipNorm;
+      sm[2] *= recipNorm;
+      sm[3] *= recipNorm;
+
+      /* apply the feedback step of the lane's algorithm: */
+      vf_t s0 = KERNEL(select)(use_mag, sm[0], si[0]);
+      vf_t s1 = KERNEL(select)(use_mag, sm[1], si[1]);
+      vf_t s2 = KERNEL(select)(use_mag, sm[2], si[2]);
+      vf_t s3 = KERNEL(select)(use_mag, sm[3], si[3]);
+      qDot0 = KERNEL(select)(acc_ok, qDot0 - beta * s0, qDot0);
+      qDot1 = KERNEL(select)(acc_ok, qDot1 - beta * s1, qDot1);
+      qDot2 = KERNEL(select)(acc_ok, qDot2 - beta * s2, qDot2);
+      qDot3 = KERNEL(select)(acc_ok, qDot3 - beta * s3, qDot3);
+
+      /* integrate rate of change of quaternion and normalise: */
+      q0 += qDot0 * dt;
+      q1 += qDot1 * dt;
+      q2 += qDot2 * dt;
+      q3 += qDot3 * dt;
+      recipNorm = KERNEL(inv_sqrt)(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+      KERNEL(store)(&batch->q0[i], q0 * recipNorm);
+      KERNEL(store)(&batch->q1[i], q1 * recipNorm);
+      KERNEL(store)(&batch->q2[i], q2 * recipNorm);
+      KERNEL(store)(&batch->q3[i], q3 * recipNorm);
+   }
+   return i;
+}
+
+
+static TARGET size_t KERNEL(mahony_batch)(mahony_ahrs_batch_t *batch, const ahrs_batch_in_t *in)
+{
+   size_t i;
+   for (i = 0; i + LANES <= batch->n; i += LANES)
+   {
+      vf_t q0 = KERNEL(load)(&batch->q0[i]);
+      vf_t q1 = KERNEL(load)(&batch->q1[i]);
+      vf_t q2 = KERNEL(load)(&batch->q2[i]);
+      vf_t q3 = KERNEL(load)(&batch->q3[i]);
+      vf_t twoKp = KERNEL(load)(&batch->twoKp[i]);
+      vf_t twoKi = KERNEL(load)(&batch->twoKi[i]);
+      vf_t integralFBx = KERNEL(load)(&batch->integralFBx[i]);
+      vf_t integralFBy = KERNEL(load)(&batch->integralFBy[i]);
+      vf_t integralFBz = KERNEL(load)(&batch->integralFBz[i]);
+      vf_t gx = KERNEL(load)(&in->gx[i]);
+      vf_t gy = KERNEL(load)(&in->gy[i]);
+      vf_t gz = KERNEL(load)(&in->gz[i]);
+      vf_t ax = KERNEL(load)(&in->ax[i]);
+      vf_t ay = KERNEL(load)(&in->ay[i]);
+      vf_t az = KERNEL(load)(&in->az[i]);
+      vf_t mx = KERNEL(load)(&in->mx[i]);
+      vf_t my = KERNEL(load)(&in->my[i]);
+      vf_t mz = KERNEL(load)(&in->mz[i]);
+      vf_t dt = KERNEL(load)(&in->dt[i]);
+      vf_t recipNorm;
+
+      vi_t use_mag = ~((mx == 0.0f) & (my == 0.0f) & (mz == 0.0f));
+      vi_t acc_ok = ~((ax == 0.0f) & (ay == 0.0f) & (az == 0.0f));
+      vi_t ki_on = twoKi > 0.0f;
+
+      /* normalise accelerometer and magnetometer measurements: */
+      recipNorm = KERNEL(inv_sqrt)(ax * ax + ay * ay + az * az);
+      ax *= recipNorm;
+      ay *= recipNorm;
+      az *= recipNorm;
+      recipNorm = KERNEL(inv_sqrt)(mx * mx + my * my + mz * mz);
+      mx *= recipNorm;
+      my *= recipNorm;
+      mz *= recipNorm;
+
+      /* auxiliary variables to avoid repeated arithmetic: */
+      vf_t q0q0 = q0 * q0;
+      vf_t q0q1 = q0 * q1;
+      vf_t q0q2 = q0 * q2;
+      vf_t q0q3 = q0 * q3;
+      vf_t q1q1 = q1 * q1;
+      vf_t q1q2 = q1 * q2;
+      vf_t q1q3 = q1 * q3;
+      vf_t q2q2 = q2 * q2;
+      vf_t q2q3 = q2 * q3;
+      vf_t q3q3 = q3 * q3;
+
+      /* reference direction of Earth's magnetic field: */
+      vf_t hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+      vf_t hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+      vf_t bx = vf_sqrt(hx * hx + hy * hy);
+      vf_t bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+
+      /* estimated direction of gravity and magnetic field: */
+      vf_t halfvx = q1q3 - q0q2;
+      vf_t halfvy = q0q1 + q2q3;
+      vf_t halfvz = q0q0 - 0.5f + q3q3;
+      vf_t halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+      vf_t halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+      vf_t halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+
+      /* error, the magnetic field only contributes in lanes using it: */
+      vf_t halfex = (ay * halfvz - az * halfvy);
+      vf_t halfey = (az * halfvx - ax * halfvz);
+      vf_t halfez = (ax * halfvy - ay * halfvx);
+      halfex = KERNEL(select)(use_mag, halfex + (my * halfwz - mz * halfwy), halfex);
+      halfey = KERNEL(select)(use_mag, halfey + (mz * halfwx - mx * halfwz), halfey);
+      halfez = KERNEL(select)(use_mag, halfez + (mx * halfwy - my * halfwx), halfez);
+
+      /* integral feedback if enabled, otherwise the integral is reset: */
+      vf_t zero = {0.0f};
+      integralFBx = KERNEL(select)(acc_ok, KERNEL(select)(ki_on, integralFBx + twoKi * halfex * dt, zero), integralFBx);
+      integralFBy = KERNEL(select)(acc_ok, KERNEL(select)(ki_on, integralFBy + twoKi * halfey * dt, zero), integralFBy);
+      integralFBz = KERNEL(select)(acc_ok, KERNEL(select)(ki_on, integralFBz + twoKi * halfez * dt, zero), integralFBz);
+      gx = KERNEL(select)(acc_ok & ki_on, gx + integralFBx, gx);
+      gy = KERNEL(select)(acc_ok & ki_on, gy + integralFBy, gy);
+      gz = KERNEL(select)(acc_ok & ki_on, gz + integralFBz, gz);
+
+      /* proportional feedback: */
+      gx = KERNEL(select)(acc_ok, gx + twoKp * halfex, gx);
+      gy = KERNEL(select)(acc_ok, gy + twoKp * halfey, gy);
+      gz = KERNEL(select)(acc_ok, gz + twoKp * halfez, gz);
+
+      /* integrate rate of change of quaternion and normalise: */
+      gx *= 0.5f * dt;
+      gy *= 0.5f * dt;
+      gz *= 0.5f * dt;
+      vf_t qa = q0;
+      vf_t qb = q1;
+      vf_t qc = q2;
+      q0 += (-qb * gx - qc * gy - q3 * gz);
+      q1 += (qa * gx + qc * gz - q3 * gy);
+      q2 += (qa * gy - qb * gz + q3 * gx);
+      q3 += (qa * gz + qb * gy - qc * gx);
+      recipNorm = KERNEL(inv_sqrt)(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+      KERNEL(store)(&batch->q0[i], q0 * recipNorm);
+      KERNEL(store)(&batch->q1[i], q1 * recipNorm);
+      KERNEL(store)(&batch->q2[i], q2 * recipNorm);
+      KERNEL(store)(&batch->q3[i], q3 * recipNorm);
+      KERNEL(store)(&batch->integralFBx[i], integralFBx);
+      KERNEL(store)(&batch->integralFBy[i], integralFBy);
+      KERNEL(store)(&batch->integralFBz[i], integralFBz);
+   }
+   return i;
+}
+
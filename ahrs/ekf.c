@@ -1,356 +1,393 @@
-
 /*
- * original code from CHRobotics
+ * multiplicative quaternion EKF with gyro bias states,
+ * replaces the euler angle EKF originally from CHRobotics
  * modification by Tobias Simon
+ *
+ * the filter estimates the error of the body to reference quaternion
+ * as a small rotation in the body frame, q = q_est * dq(dtheta),
+ * which is folded into the quaternion after each correction;
+ * propagation needs no trigonometry and has no singularities
  */
 
 
-#include <stdio.h>
 #include <math.h>
 #include <string.h>
 
-#include "matrix3x3.h"
+#include "../util/matrix.h"
 #include "ekf.h"
+#include "ekf_kernels.h"
+
 
+#define N EKF_STATES
 
-ekf_config_t gConfig;
-ahrs_state_t ekf_state;
+/* index of P(i, j), i <= j, in the packed upper triangle: */
+#define P_IDX(i, j) ((i) * (2 * N - (i) + 1) / 2 + (j) - (i))
 
+/* initial variances: */
+#define INIT_ATT_VAR 0.01 /* rad^2 */
+#define INIT_BIAS_VAR 1.0e-4 /* (rad / s)^2 */
 
-void ekf_init(void)
+
+/* quat = quat * (1, v), normalized; a first order rotation by 2 * v: */
+static void quat_rotate(quat_t *quat, const double *v)
 {
-   int i, j;
-   memset(&ekf_state, 0, sizeof(ahrs_state_t));
+   double q0 = quat->q0, q1 = quat->q1, q2 = quat->q2, q3 = quat->q3;
+   double r[4];
+   r[0] = q0 - q1 * v[0] - q2 * v[1] - q3 * v[2];
+   r[1] = q1 + q0 * v[0] + q2 * v[2] - q3 * v[1];
+   r[2] = q2 + q0 * v[1] - q1 * v[2] + q3 * v[0];
+   r[3] = q3 + q0 * v[2] + q1 * v[1] - q2 * v[0];
+   double norm = 1.0 / sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + r[3] * r[3]);
+   int i;
+   for (i = 0; i < 4; i++)
+   {
+      quat->vec[i] = r[i] * norm;
+   }
+}
 
-   for (i = 0; i < 3; i++ )
+
+/* normalizes v, returns 0 for a zero vector: */
+static int normalize(double *v)
+{
+   double len = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+   if (len == 0.0)
+   {
+      return 0;
+   }
+   int i;
+   for (i = 0; i < 3; i++)
    {
-      ekf_state.P.data[i][i] = 0.01;
+      v[i] /= len;
    }
- 
-   /* set process noise matrix: */
-   ekf_state.Q.data[0][0] = gConfig.process_covariance;
-   ekf_state.Q.data[1][1] = gConfig.process_covariance;
-   ekf_state.Q.data[2][2] = gConfig.process_covariance;
- 
-   /* set measurement noise matrices: */
-   ekf_state.R_acc.data[0][0] = gConfig.acc_covariance;
-   ekf_state.R_acc.data[1][1] = gConfig.acc_covariance;
-   ekf_state.R_acc.data[2][2] = gConfig.acc_covariance;
- 
-   ekf_state.R_mag.data[0][0] = gConfig.mag_covariance;
-   ekf_state.R_mag.data[1][1] = gConfig.mag_covariance;
-   ekf_state.R_mag.data[2][2] = gConfig.mag_covariance;
+   return 1;
 }
 
 
-void ekf_sensor_init(raw_sensor_data_t *sensor_data)
+static void reset_state(ekf_t *ekf)
 {
-   int i, j;
-   memset(&ekf_state, 0, sizeof(ahrs_state_t));
+   memset(&ekf->state, 0, sizeof(ahrs_state_t));
+   ekf->state.quat.q0 = 1.0f;
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      ekf->state.P[P_IDX(i, i)] = INIT_ATT_VAR;
+      ekf->state.P[P_IDX(i + 3, i + 3)] = INIT_BIAS_VAR;
+   }
+}
 
-   /* Compute initial roll and pitch angles */
-   double theta_a = -atan2(sensor_data->acc.x, sensor_data->acc.z);
-   double phi_a = -atan2(sensor_data->acc.y, sensor_data->acc.z);
 
-   ekf_state.phi = phi_a;
-   ekf_state.theta = theta_a;
-   ekf_state.psi = 0;
+double ekf_cov(const ahrs_state_t *state, int i, int j)
+{
+   return i <= j ? state->P[P_IDX(i, j)] : state->P[P_IDX(j, i)];
+}
 
-   ekf_state.phi_dot = 0;
-   ekf_state.theta_dot = 0;
-   ekf_state.psi_dot = 0;
 
-   ekf_state.P.data[0][0] = 0.01;
-   ekf_state.P.data[1][1] = 0.01;
-   ekf_state.P.data[1][1] = 0.01;
+void ekf_init(ekf_t *ekf)
+{
+   reset_state(ekf);
+}
+
 
-   for (i = 0; i < 3; i++ )
+void ekf_sensor_init(ekf_t *ekf, raw_sensor_data_t *sensor_data)
+{
+   reset_state(ekf);
+
+   /* shortest rotation of the measured onto the reference acceleration, i.e. heading 0: */
+   double a[3], r[3];
+   int i;
+   for (i = 0; i < 3; i++)
    {
-      for (j = 0; j < 3; j++)
+      a[i] = sensor_data->acc.data[i] - ekf->config.acc_biases.data[i];
+      r[i] = ekf->config.acc_ref.data[i];
+   }
+   if (!normalize(a) || !normalize(r))
+   {
+      return;
+   }
+   double q[4] = {1.0 + a[0] * r[0] + a[1] * r[1] + a[2] * r[2],
+                  a[1] * r[2] - a[2] * r[1],
+                  a[2] * r[0] - a[0] * r[2],
+                  a[0] * r[1] - a[1] * r[0]};
+   if (q[0] < 1.0e-6)
+   {
+      /* upside down, turn around any axis normal to the reference: */
+      q[0] = 0.0;
+      q[1] = 0.0;
+      q[2] = r[2];
+      q[3] = -r[1];
+      if (r[1] == 0.0 && r[2] == 0.0)
       {
-         ekf_state.Q.data[i][j] = 0;
-         ekf_state.R_acc.data[i][j] = 0;
-         ekf_state.R_mag.data[i][j] = 0;
+         q[2] = 1.0;
       }
    }
+   double norm = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+   for (i = 0; i < 4; i++)
+   {
+      ekf->state.quat.vec[i] = q[i] / norm;
+   }
+}
 
-   /* set process noise matrix: */
-   ekf_state.Q.data[0][0] = gConfig.process_covariance;
-   ekf_state.Q.data[1][1] = gConfig.process_covariance;
-   ekf_state.Q.data[2][2] = gConfig.process_covariance;
 
-   /* set measurement noise matrices: */
-   ekf_state.R_acc.data[0][0] = gConfig.acc_covariance;
-   ekf_state.R_acc.data[1][1] = gConfig.acc_covariance;
-   ekf_state.R_acc.data[2][2] = gConfig.acc_covariance;
+static void ekf_predict(ekf_t *ekf, double T)
+{
+   ahrs_state_t *st = &ekf->state;
+   double w[3];
+   int i, j;
+   for (i = 0; i < 3; i++)
+   {
+      w[i] = st->rate.data[i] - st->gyro_bias.data[i];
+   }
+
+   /* q = q * (1, w * T / 2): */
+   double v[3] = {0.5 * T * w[0], 0.5 * T * w[1], 0.5 * T * w[2]};
+   quat_rotate(&st->quat, v);
+
+   /* error dynamics: F = | M  -T * I |, M = I - T * [w x]
+                          | 0     I    |
+      with P = | A    B |, F * P * F^T = | M * A * M^T - T * (G + G^T) + T^2 * C   G - T * C |
+               | B^T  C |                |                  ...                      C     |
+      and G = M * B: */
+   mat3x3_t M =
+   {{
+      {1.0, T * w[2], -T * w[1]},
+      {-T * w[2], 1.0, T * w[0]},
+      {T * w[1], -T * w[0], 1.0}
+   }};
+   mat3x3_t A, B, C;
+   for (i = 0; i < 3; i++)
+   {
+      for (j = 0; j < 3; j++)
+      {
+         A.data[i][j] = ekf_cov(st, i, j);
+         B.data[i][j] = st->P[P_IDX(i, j + 3)];
+         C.data[i][j] = ekf_cov(st, i + 3, j + 3);
+      }
+   }
+   mat3x3_t G;
+   /* A = M * A * M^T, in place: */
+   mat3x3_mul(&A, &M, &A);
+   mat3x3_mul_trans(&A, &A, &M);
+   mat3x3_mul(&G, &M, &B);
+   for (i = 0; i < 3; i++)
+   {
+      for (j = i; j < 3; j++)
+      {
+         st->P[P_IDX(i, j)] = A.data[i][j] - T * (G.data[i][j] + G.data[j][i]) + T * T * C.data[i][j];
+      }
+      for (j = 0; j < 3; j++)
+      {
+         st->P[P_IDX(i, j + 3)] = G.data[i][j] - T * C.data[i][j];
+      }
+   }
 
-   ekf_state.R_mag.data[0][0] = gConfig.mag_covariance;
-   ekf_state.R_mag.data[1][1] = gConfig.mag_covariance;
-   ekf_state.R_mag.data[2][2] = gConfig.mag_covariance;
+   /* + Q * T: */
+   for (i = 0; i < 3; i++)
+   {
+      st->P[P_IDX(i, i)] += ekf->config.process_covariance * T;
+      st->P[P_IDX(i + 3, i + 3)] += ekf->config.bias_covariance * T;
+   }
 }
 
 
-static void unroll_states(ahrs_state_t *states)
+/* propagates the state to the given sample time with the latest gyro rates: */
+static void ekf_advance(ekf_t *ekf, uint64_t time)
 {
-   while (states->phi > 2.0 * M_PI)
+   if (ekf->state.time != 0 && time > ekf->state.time)
    {
-      states->phi -= 2.0 * M_PI;
+      ekf_predict(ekf, (time - ekf->state.time) / 1.0e9);
    }
-
-   while (states->phi < -2.0 * M_PI)
+   if (time > ekf->state.time)
    {
-      states->phi += 2.0 * M_PI;
+      ekf->state.time = time;
    }
+}
+
 
-   while (states->theta > 2.0 * M_PI)
+/* folds the estimated error into quaternion and bias: */
+static void ekf_reset(ekf_t *ekf, const double *dx)
+{
+   double v[3] = {0.5 * dx[0], 0.5 * dx[1], 0.5 * dx[2]};
+   quat_rotate(&ekf->state.quat, v);
+   int i;
+   for (i = 0; i < 3; i++)
    {
-      states->theta -= 2.0 * M_PI;
+      ekf->state.gyro_bias.data[i] += dx[i + 3];
    }
+}
+
+
+static void set_rate(ekf_t *ekf, const vec3d_t *gyro)
+{
+   vec3d_t pqr;
+   vec3d_mul(&pqr, &ekf->config.gyro_scales, gyro);
+   mat3x3_mul_vec(&pqr, &ekf->config.gyro_alignment, &pqr);
+   vec3d_sub(&ekf->state.rate, &pqr, &ekf->config.gyro_biases);
+}
+
 
-   while (states->theta < -2.0 * M_PI)
+/*
+ * updates P and the error dx with the scalar measurement y = H * dx + noise of variance r;
+ * only the attitude part h of H is non-zero, zero entries of h are skipped
+ */
+static void scalar_update(ahrs_state_t *st, const double *h, double y, double r, double *dx)
+{
+   int i, j, k;
+
+   /* u = P * H^T, s = H * P * H^T + r: */
+   double u[N];
+   for (i = 0; i < N; i++)
+   {
+      u[i] = 0.0;
+   }
+   for (k = 0; k < 3; k++)
    {
-      states->theta += 2.0 * M_PI;
+      if (h[k] != 0.0)
+      {
+         for (i = 0; i < N; i++)
+         {
+            u[i] += ekf_cov(st, i, k) * h[k];
+         }
+      }
    }
+   double s = h[0] * u[0] + h[1] * u[1] + h[2] * u[2] + r;
 
-   while (states->psi > 2.0 * M_PI)
+   /* the error dx already estimated by earlier components changes the innovation: */
+   double innov = y - (h[0] * dx[0] + h[1] * dx[1] + h[2] * dx[2]);
+   double K[N];
+   for (i = 0; i < N; i++)
    {
-      states->psi -= 2.0 * M_PI;
+      K[i] = u[i] / s;
+      dx[i] += K[i] * innov;
    }
 
-   while (states->psi < -2.0 * M_PI)
+   /* Joseph form P = (I - K * H) * P * (I - K * H)^T + K * r * K^T, which stays
+      positive semidefinite under rounding and for a suboptimal K;
+      M = (I - K * H) * P = P - K * u^T, then M * (I - K * H)^T = M - (M * H^T) * K^T: */
+   double M[N][N];
+   double v[N];
+   for (i = 0; i < N; i++)
    {
-      states->psi += 2.0 * M_PI;
+      v[i] = 0.0;
+      for (j = 0; j < N; j++)
+      {
+         M[i][j] = ekf_cov(st, i, j) - K[i] * u[j];
+      }
+      for (k = 0; k < 3; k++)
+      {
+         v[i] += M[i][k] * h[k];
+      }
+   }
+   for (i = 0; i < N; i++)
+   {
+      for (j = i; j < N; j++)
+      {
+         st->P[P_IDX(i, j)] = M[i][j] - v[i] * K[j] + r * K[i] * K[j];
+      }
    }
 }
 
 
-static void ekf_predict(raw_sensor_data_t *sensor_data, double T)
+void ekf_update_gyro(ekf_t *ekf, const vec3d_t *gyro, uint64_t time)
 {
-   /* roll, pitch, yaw */
-   double phi, theta, psi;
-   double phi_dot, theta_dot, psi_dot;
-   double p, q, r;
+   set_rate(ekf, gyro);
+   ekf_advance(ekf, time);
+}
 
-   mat3x3_t A, A_transpose, AP, PA_transpose, temp;
-   int32_t i;
 
-   /* scale gyro values: */
-   vec3d_t pqr;
-   vec_vec_elem_mul_3(&gConfig.gyro_scales, &sensor_data->gyro, &pqr);
-   /* multiply gyro outputs by gyro alignment matrix: */
-   mat_vect_mult3(&gConfig.gyro_alignment, &pqr, &pqr );
-   p = pqr.x; q = pqr.y; r = pqr.z;
-
-   /* get current state estimates: */
-   phi = ekf_state.phi;
-   theta = ekf_state.theta;
-   psi = ekf_state.psi;
- 
-   double c_phi = cos(phi);
-   double t_theta = tan(theta);
-   double s_phi = sin(phi);
-   double c_theta = cos(theta);
-   double s_theta = sin(theta);
- 
-   /* compute expected angle rates based on gyro outputs 
-      measured rotations  must be transformed into the inertial frame (we can't just integrate the gyro outputs): */
-   phi_dot = p + s_phi * t_theta * q + c_phi * t_theta * r;
-   theta_dot = c_phi * q - s_phi * r;
-   psi_dot = (s_phi / c_theta) * q + (c_phi / c_theta) * r;
- 
-   ekf_state.phi_dot = phi_dot;
-   ekf_state.theta_dot = theta_dot;
-   ekf_state.psi_dot = psi_dot;
-
-   /* compute new angle estimates: */
-   phi = phi + T * phi_dot;
-   theta = theta + T * theta_dot;
-   psi = psi + T * psi_dot;
- 
-   /* linearize propogation equation for covariance estimation (build the matrix A): */
-   #define A(i,j) A.data[i][j]
-   A(0, 0) = q * c_phi * t_theta - r * s_phi * t_theta;   A(0, 1) = r * c_phi * (t_theta * t_theta + 1) + q * s_phi * (t_theta * t_theta + 1);               A(0, 2) = 0;
-   A(1, 0) = -r * c_phi - q * s_phi;                      A(1, 1) = 0;                                                                                       A(1, 2) = 0;
-   A(2, 0) = q * c_phi / c_theta - r * s_phi / c_theta;   A(2, 1) = r * c_phi * s_theta / (c_theta * c_theta) + q * s_phi * s_theta / (c_theta * c_theta);   A(2, 2) = 0;
- 
-   /* compute new covariance: P = P + T * (AP + PA ^ T + Q): */
-   mat_mul_3x3(&A, &ekf_state.P, &AP );
-   mat_trans_3x3(&A, &A_transpose);
-   mat_mul_3x3(&ekf_state.P, &A_transpose, &PA_transpose);
-   mat_add_3x3(&AP, &PA_transpose, &temp);
-   mat_add_3x3(&temp, &ekf_state.Q, &temp);
-   scalar_mat_mult_3x3(T, &temp, &temp);
-   mat_add_3x3(&temp, &ekf_state.P, &ekf_state.P);
-
-   /* update states estimates in data structure: */
-   ekf_state.phi = phi;
-   ekf_state.theta = theta;
-   ekf_state.psi = psi;
-   unroll_states(&ekf_state);
+void ekf_update_acc(ekf_t *ekf, const vec3d_t *acc, uint64_t time)
+{
+   ekf_advance(ekf, time);
+   ahrs_state_t *st = &ekf->state;
+   int i;
+
+   /* measured and reference direction of the acceleration: */
+   vec3d_t acc_vec;
+   vec3d_sub(&acc_vec, acc, &ekf->config.acc_biases);
+   mat3x3_mul_vec(&acc_vec, &ekf->config.acc_alignment, &acc_vec);
+   double r[3];
+   for (i = 0; i < 3; i++)
+   {
+      r[i] = ekf->config.acc_ref.data[i];
+   }
+   if (!normalize(acc_vec.data) || !normalize(r))
+   {
+      return;
+   }
+
+   /* expected measurement h = R^T * r and its jacobian H = | [h x]  0 |: */
+   const quat_t *q = &st->quat;
+   double h[3];
+   ekf_acc_model(h, q->q0, q->q1, q->q2, q->q3, r[0], r[1], r[2]);
+   double Hs[3][3] = {{0.0, -h[2], h[1]}, {h[2], 0.0, -h[0]}, {-h[1], h[0], 0.0}};
+
+   /* the components have independent noise, so they are applied one after another: */
+   double dx[N] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+   for (i = 0; i < 3; i++)
+   {
+      scalar_update(st, Hs[i], acc_vec.data[i] - h[i], ekf->config.acc_covariance, dx);
+   }
+   ekf_reset(ekf, dx);
 }
 
 
-static void ekf_update(raw_sensor_data_t *sensor_data)
+void ekf_update_mag(ekf_t *ekf, const vec3d_t *mag, uint64_t time)
 {
-   mat3x3_t R, L, C, Ctrans, PCtrans, LC, temp, I;
-   identity_3x3(&I);
-
-   if (sensor_data->new_acc_data)
+   ekf_advance(ekf, time);
+   ahrs_state_t *st = &ekf->state;
+
+   /* rotate the measurement into the reference frame, H is the third row of the rotation matrix: */
+   vec3d_t mag_vec;
+   vec3d_sub(&mag_vec, mag, &ekf->config.mag_biases);
+   mat3x3_mul_vec(&mag_vec, &ekf->config.mag_cal, &mag_vec);
+   const quat_t *q = &st->quat;
+   double m[2], H[3];
+   ekf_mag_model(m, H, q->q0, q->q1, q->q2, q->q3, mag_vec.x, mag_vec.y, mag_vec.z);
+   const vec3d_t *ref = &ekf->config.mag_ref;
+   if ((m[0] == 0.0 && m[1] == 0.0) || (ref->x == 0.0 && ref->y == 0.0))
    {
-      sensor_data->new_acc_data = 0;
-      /* shortcut trigonometry definitions: */
-      #define trig_short() \
-         double theta = ekf_state.theta; double phi = ekf_state.phi; double psi = ekf_state.psi; \
-         double c_phi = cos(phi); double c_theta = cos(theta); double c_psi = cos(psi); \
-         double s_phi = sin(phi); double s_theta = sin(theta); double s_psi = sin(psi)
-      trig_short();
-
-      /* build rotation matrix from inertial frame to body frame
-         for computing expected sensor outputs given yaw, pitch, and roll angles): */
-      #define R(i,j) R.data[i][j]
-      R(0, 0) = c_psi * c_theta;
-      R(0, 1) = c_theta * s_psi;
-      R(0, 2) = -s_theta;
-      R(1, 0) = c_psi * s_phi * s_theta - c_phi * s_psi;
-      R(1, 1) = c_phi * c_psi + s_phi * s_psi * s_theta;   
-      R(1, 2) = c_theta * s_phi;
-      R(2, 0) = s_phi * s_psi + c_phi * c_psi * s_theta;       
-      R(2, 1) = c_phi * s_psi * s_theta - c_psi * s_phi;   
-      R(2, 2) = c_phi * c_theta;
-
-      /* subtract accel bias vector: */
-      vec3d_t acc_ref;
-      vec_sub_3(&gConfig.acc_ref, &gConfig.acc_biases, &acc_ref);
-
-      /* multiply accel reference vector by calibration matrix: */
-      mat_vect_mult3(&gConfig.acc_alignment, &acc_ref, &acc_ref);
-
-      /* compute expected accelerometer output based on yaw, pitch, and roll angles: */
-      vec3d_t acc_hat;
-      mat_vect_mult3(&R, &acc_ref, &acc_hat);
-
-      /* compute C matrix for Kalman gain calculation: */
-      #define ax acc_ref.data[0]
-      #define ay acc_ref.data[1]
-      #define az acc_ref.data[2]
-      #define C(i,j) C.data[i][j]
-      C(0, 0) = 0;
-      C(0, 1) = -az * c_theta - ax * c_psi * s_theta - ay * s_psi * s_theta;
-      C(0, 2) = ay * c_psi * c_theta - ax * c_theta * s_psi;
-      C(1, 0) = ax * (s_phi * s_psi + c_phi * c_psi * s_theta) - ay * (c_psi * s_phi - c_phi * s_psi * s_theta) + az * c_phi * c_theta;
-      C(1, 1) = ax * c_psi * c_theta * s_phi - az * s_phi * s_theta + ay * c_theta * s_phi * s_psi;
-      C(1, 2) = -ax * (c_phi * c_psi + s_phi * s_psi * s_theta) - ay * (c_phi * s_psi - c_psi * s_phi * s_theta);
-      C(2, 0) = ax * (c_phi * s_psi - c_psi * s_phi * s_theta) - ay * (c_phi * c_psi + s_phi * s_psi * s_theta) - az * c_theta * s_phi;
-      C(2, 1) = ax * c_phi * c_psi * c_theta - az * c_phi * s_theta + ay * c_phi * c_theta * s_psi;
-      C(2, 2) = ax * (c_psi * s_phi - c_phi * s_psi * s_theta) + ay * (s_phi * s_psi + c_phi * c_psi * s_theta);
-
-      /* compute kalman gain: L = PC^T * (R + CPC^T)^(-1) */
-      mat_trans_3x3(&C, &Ctrans);
-      mat_mul_3x3(&ekf_state.P, &Ctrans, &PCtrans);
-      mat_mul_3x3(&C, &PCtrans, &temp);
-      mat_add_3x3(&temp, &ekf_state.R_acc, &temp);
-      mat_inv_3x3(&temp, &temp);
-      mat_mul_3x3(&PCtrans, &temp, &L);
-
-      /* compute new covariance: */
-      mat_mul_3x3(&L, &C, &LC);
-      scalar_mat_mult_3x3(-1, &LC, &temp);
-      mat_add_3x3(&I, &temp, &temp);
-      mat_mul_3x3(&temp, &ekf_state.P, &ekf_state.P);
-
-      /* subtract accel bias from sensor readings: */
-      vec3d_t acc_vec;
-      vec_sub_3(&sensor_data->acc, &gConfig.acc_biases, &acc_vec);
-
-      /* apply alignment correction */
-      mat_vect_mult3(&gConfig.acc_alignment, &acc_vec, &acc_vec);
-  
-      /* subtract the reference vector: */
-      vec_sub_3(&acc_vec, &acc_hat, &acc_vec);
-
-      /* multiply by Kalman gain: */
-      vec3d_t correction;
-      mat_vect_mult3(&L, &acc_vec, &correction);
-
-      /* only update pitch and roll: */
-      ekf_state.phi = ekf_state.phi + correction.data[0];
-      ekf_state.theta = ekf_state.theta + correction.data[1];
-
-      /* "unroll" angle estimates to be in the range from -360 to 360 degrees */
-      unroll_states(&ekf_state);
+      return;
    }
 
-   if (sensor_data->new_mag_data)
+   /* only the heading is observed, so the field inclination cannot tilt the attitude;
+      the heading error is the vertical component of the attitude error in the reference frame: */
+   double y = atan2(ref->y, ref->x) - atan2(m[1], m[0]);
+   if (y > M_PI)
    {
-      sensor_data->new_mag_data = 0;
-      trig_short();
- 
-      /* get magnetic field reference vector and subtract bias vector: */
-      vec3d_t mag_ref;
-      vec_sub_3(&gConfig.mag_ref, &gConfig.mag_biases, &mag_ref);
-
-      /* apply calibration matrix to mag reference vector: */
-      mat_vect_mult3(&gConfig.mag_cal, &mag_ref, &mag_ref);
-
-      /* compute C based on magnetic field data in inertial frame: */
-      C(0, 0) = 0;   C(0, 1) = 0;   C(0, 2) = mag_ref.y * c_psi - mag_ref.x * s_psi;
-      C(1, 0) = 0;   C(1, 1) = 0;   C(1, 2) = -mag_ref.x * c_psi - mag_ref.y * s_psi;
-      C(2, 0) = 0;   C(2, 1) = 0;   C(2, 2) = 0;
-
-      /* rotate reference vector into vehicle-1 frame: */
-      R(0, 0) = c_psi;    R(0, 1) = s_psi;   R(0, 2) = 0;
-      R(1, 0) = -s_psi;   R(1, 1) = c_psi;   R(1, 2) = 0;
-      R(2, 0) = 0;        R(2, 1) = 0;       R(2, 2) = 1;
-      mat_vect_mult3(&R, &mag_ref, &mag_ref);
-
-      /* get magnetic field measurement and subtract bias: */
-      vec3d_t mag_vect;
-      vec_sub_3(&sensor_data->mag, &gConfig.mag_biases, &mag_vect);
-
-      /* apply calibration matrix to magnetic field measurements: */
-      mat_vect_mult3(&gConfig.mag_cal, &mag_vect, &mag_vect);
-
-      /* Build rotation matrix from body frame to vehicle-1 frame (ie. only yaw remains uncorrected) */
-      R(0, 0) = c_theta;    R(0, 1) = s_phi * s_theta;   R(0, 2) = c_phi * s_theta;
-      R(1, 0) = 0;          R(1, 1) = c_phi;             R(1, 2) = -s_phi;
-      R(2, 0) = -s_theta;   R(2, 1) = c_theta * s_phi;   R(2, 2) = c_phi * c_theta;
-  
-      /* rotate measurement into vehicle-1 frame: */
-      mat_vect_mult3(&R, &mag_vect, &mag_vect);
-
-      /* subtract reference vector: */
-      vec_sub_3(&mag_vect, &mag_ref, &mag_vect);
-  
-      /* compute Kalman gain: L = PC^T * (R + CPC^T)^(-1): */
-      mat_trans_3x3(&C, &Ctrans);
-      mat_mul_3x3(&ekf_state.P, &Ctrans, &PCtrans);
-      mat_mul_3x3(&C, &PCtrans, &temp);
-      mat_add_3x3(&temp, &ekf_state.R_mag, &temp);
-      mat_inv_3x3(&temp, &temp);
-      mat_mul_3x3(&PCtrans, &temp, &L);
-  
-      /* Compute new covariance: */
-      mat_mul_3x3(&L, &C, &LC);
-      scalar_mat_mult_3x3(-1, &LC, &temp);
-      mat_add_3x3(&I, &temp, &temp);
-      mat_mul_3x3(&temp, &ekf_state.P, &ekf_state.P);
-  
-      /* Perform state update: */
-      vec3d_t correction;
-      mat_vect_mult3(&L, &mag_vect, &correction);
-        
-      /* only update yaw: */
-      ekf_state.psi = ekf_state.psi + correction.data[2];
-  
-      /* "unroll" angle estimates to be in the range from -360 to 360 degrees: */
-      unroll_states(&ekf_state);
+      y -= 2.0 * M_PI;
+   }
+   else if (y < -M_PI)
+   {
+      y += 2.0 * M_PI;
    }
+   double dx[N] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+   scalar_update(st, H, y, ekf->config.mag_covariance, dx);
+   ekf_reset(ekf, dx);
 }
 
 
-void ekf_run(raw_sensor_data_t *sensor_data, double T)
+/*
+ * applies the measurements at their own sample times in temporal order
+ * and propagates the state to the gyro sample time
+ */
+void ekf_run(ekf_t *ekf, raw_sensor_data_t *sensor_data)
 {
-   ekf_predict(sensor_data, T);
-   ekf_update(sensor_data);
+   set_rate(ekf, &sensor_data->gyro);
+   int acc_first = sensor_data->acc_time <= sensor_data->mag_time;
+   if (acc_first && sensor_data->new_acc_data)
+   {
+      sensor_data->new_acc_data = 0;
+      ekf_update_acc(ekf, &sensor_data->acc, sensor_data->acc_time);
+   }
+   if (sensor_data->new_mag_data)
+   {
+      sensor_data->new_mag_data = 0;
+      ekf_update_mag(ekf, &sensor_data->mag, sensor_data->mag_time);
+   }
+   if (!acc_first && sensor_data->new_acc_data)
+   {
+      sensor_data->new_acc_data = 0;
+      ekf_update_acc(ekf, &sensor_data->acc, sensor_data->acc_time);
+   }
+   ekf_advance(ekf, sensor_data->gyro_time);
 }
 
@@ -1,6 +1,7 @@
 
 /*
- * original code from CHRobotics
+ * multiplicative quaternion EKF with gyro bias states,
+ * replaces the euler angle EKF originally from CHRobotics
  * modification by Tobias Simon
  */
 
@@ -10,7 +11,9 @@
 
 
 #include <stdint.h>
-#include "matrix3x3.h"
+
+#include "../util/matrix.h"
+#include "../util/math.h"
 
 
 typedef struct 
@@ -24,9 +27,10 @@ typedef struct
    vec3d_t mag_biases;
 
    /* covariances: */
-   double process_covariance;
-   double acc_covariance;
-   double mag_covariance;
+   double process_covariance; /* gyro noise, rad^2 / s */
+   double bias_covariance; /* gyro bias random walk, (rad / s)^2 / s */
+   double acc_covariance; /* of the normalized acceleration */
+   double mag_covariance; /* of the heading, rad^2 */
 
    /* alignments/calibration: */
    mat3x3_t gyro_alignment;
@@ -40,82 +44,68 @@ typedef struct
 ekf_config_t;
 
 
+/* sample times in ns, e.g. monotonic_raw_ns() at the end of the transfer: */
 typedef struct
 {
+   uint64_t gyro_time;
    vec3d_t gyro;
 
    int new_acc_data;
+   uint64_t acc_time;
    vec3d_t acc;
 
    int new_mag_data;
+   uint64_t mag_time;
    vec3d_t mag;
 }
 raw_sensor_data_t;
 
 
+#define EKF_STATES 6 /* attitude error, gyro bias */
+
+
 typedef struct
 {
-   /* prientation states */
-   union 
-   {
-      double heading;
-      double yaw;
-      double psi;
-   };
-
-   union 
-   {
-      double pitch;
-      double theta;
-   };
-
-   union 
-   {
-      double roll;
-      double phi;
-   };
-
-
-   /* orientation rate states */
-   union 
-   {
-      double heading_rate;
-      double yaw_rate;
-      double psi_dot;
-   };
-
-
-   union 
-   {
-      double pitch_rate;
-      double theta_dot;
-   };
-
-   union 
-   {
-      double roll_rate;
-      double phi_dot;
-   };
-
-   /* process noise matrix: */
-   mat3x3_t Q;
- 
-   /* measurement noise matrices: */
-   mat3x3_t R_acc;
-   mat3x3_t R_mag;
- 
-   /* EKF covariance */
-   mat3x3_t P;
+   quat_t quat; /* orientation, rotates body into reference frame */
+   vec3d_t gyro_bias; /* estimated, in rad/s */
+   vec3d_t rate; /* latest scaled and aligned gyro rates, including the estimated bias */
+
+   /* covariance of attitude error (body frame, rad) and gyro bias,
+      upper triangle row by row, see ekf_cov: */
+   double P[EKF_STATES * (EKF_STATES + 1) / 2];
+
+   /* sample time the estimate refers to, 0 before the first sample: */
+   uint64_t time;
 }
 ahrs_state_t;
 
 
-extern ekf_config_t gConfig;
-extern ahrs_state_t ekf_state;
+/* one filter instance, independent of all others: */
+typedef struct
+{
+   ekf_config_t config;
+   ahrs_state_t state;
+}
+ekf_t;
+
+
+/* returns the covariance of states i and j: */
+double ekf_cov(const ahrs_state_t *state, int i, int j);
+
+/* reset the state, using ekf->config: */
+void ekf_init(ekf_t *ekf);
+
+/* reset the state, levelled by the accelerometer: */
+void ekf_sensor_init(ekf_t *ekf, raw_sensor_data_t *sensor_data);
+
+/* per-sensor updates, the state is propagated to the sample time
+   with the latest gyro rates; times in ns as in raw_sensor_data_t: */
+void ekf_update_gyro(ekf_t *ekf, const vec3d_t *gyro, uint64_t time);
+void ekf_update_acc(ekf_t *ekf, const vec3d_t *acc, uint64_t time);
+void ekf_update_mag(ekf_t *ekf, const vec3d_t *mag, uint64_t time);
 
-void ekf_init(void);
-void ekf_sensor_init(raw_sensor_data_t *sensor_data);
-void ekf_run(raw_sensor_data_t *sensor_data, double T);
+/* applies all new measurements in temporal order: */
+void ekf_run(ekf_t *ekf, raw_sensor_data_t *sensor_data);
 
 
 #endif
@@ -0,0 +1,106 @@
+
+/*
+   EKF Batch Runner Implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ekf_batch.h"
+
+
+#define MAX_THREADS 64
+
+
+typedef struct
+{
+   ekf_t *ekfs;
+   size_t n;
+   const raw_sensor_data_t *samples;
+   size_t count;
+   ekf_batch_cb_t cb;
+   void *ctx;
+   size_t next; /* next instance to run, taken atomically */
+}
+batch_t;
+
+
+static void *worker(void *arg)
+{
+   batch_t *batch = (batch_t *)arg;
+   while (1)
+   {
+      /* instances are taken one at a time, so uneven run times balance out: */
+      size_t i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+      if (i >= batch->n)
+      {
+         break;
+      }
+      size_t j;
+      for (j = 0; j < batch->count; j++)
+      {
+         /* ekf_run consumes the new data flags, so it gets a copy: */
+         raw_sensor_data_t sample = batch->samples[j];
+         ekf_run(&batch->ekfs[i], &sample);
+         if (batch->cb != NULL)
+         {
+            batch->cb(batch->ctx, i, j, &batch->ekfs[i].state);
+         }
+      }
+   }
+   return NULL;
+}
+
+
+int ekf_batch_run(ekf_t *ekfs, size_t n, const raw_sensor_data_t *samples, size_t count,
+                  int threads, ekf_batch_cb_t cb, void *ctx)
+{
+   batch_t batch = {ekfs, n, samples, count, cb, ctx, 0};
+   if (threads <= 0)
+   {
+      long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = cpus > 0 ? (int)cpus : 1;
+   }
+   if (threads > MAX_THREADS)
+   {
+      threads = MAX_THREADS;
+   }
+   if ((size_t)threads > n)
+   {
+      threads = n > 0 ? (int)n : 1;
+   }
+
+   /* the calling thread is one of the workers: */
+   pthread_t pool[MAX_THREADS];
+   int started = 0;
+   while (started < threads - 1)
+   {
+      if (pthread_create(&pool[started], NULL, worker, &batch) != 0)
+      {
+         break; /* the others take over its share */
+      }
+      started++;
+   }
+   worker(&batch);
+   int i;
+   for (i = 0; i < started; i++)
+   {
+      pthread_join(pool[i], NULL);
+   }
+   return started + 1;
+}
+
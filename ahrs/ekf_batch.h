@@ -0,0 +1,44 @@
+
+/*
+   EKF Batch Runner Interface
+
+   Runs many EKF instances, e.g. with different covariance settings,
+   over the same recorded sensor data on a pool of threads.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __EKF_BATCH_H__
+#define __EKF_BATCH_H__
+
+
+#include <stddef.h>
+
+#include "ekf.h"
+
+
+/* called after each sample with the instance and sample index;
+   calls for different instances run concurrently */
+typedef void (*ekf_batch_cb_t)(void *ctx, size_t instance, size_t sample, const ahrs_state_t *state);
+
+
+/* runs each of the n initialized instances over all count samples in order;
+   threads <= 0 uses one thread per online cpu; cb may be NULL;
+   returns the number of threads used, at least the calling one */
+int ekf_batch_run(ekf_t *ekfs, size_t n, const raw_sensor_data_t *samples, size_t count,
+                  int threads, ekf_batch_cb_t cb, void *ctx);
+
+
+#endif /* __EKF_BATCH_H__ */
+
@@ -0,0 +1,62 @@
+
+/*
+   EKF Measurement Model Kernels
+
+   Generated by ahrs/gen_kernels.py, do not edit.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __EKF_KERNELS_H__
+#define __EKF_KERNELS_H__
+
+
+/* expected acceleration direction in the body frame, 49 operations: */
+static inline void ekf_acc_model(double h[3], double q0, double q1, double q2, double q3, double rx, double ry, double rz)
+{
+   const double x0 = 2.0 * q0;
+   const double x1 = q3 * x0;
+   const double x2 = 2.0 * q1;
+   const double x3 = q2 * x0;
+   const double x4 = 2.0 * q2 * q2;
+   const double x5 = 2.0 * q3 * q3 - 1.0;
+   const double x6 = q1 * x0;
+   const double x7 = 2.0 * q1 * q1;
+   h[0] = rx * (-x4 - x5) + ry * (q2 * x2 + x1) + rz * (2.0 * q1 * q3 - x3);
+   h[1] = rx * (2.0 * q1 * q2 - x1) + ry * (-x5 - x7) + rz * (2.0 * q2 * q3 + x6);
+   h[2] = rx * (q3 * x2 + x3) + ry * (2.0 * q2 * q3 - x6) + rz * (-x4 - x7 + 1.0);
+}
+
+
+/* horizontal reference frame field and heading jacobian, 44 operations: */
+static inline void ekf_mag_model(double m[2], double H[3], double q0, double q1, double q2, double q3, double mx, double my, double mz)
+{
+   const double x0 = 2.0 * q0;
+   const double x1 = q3 * x0;
+   const double x2 = q2 * x0;
+   const double x3 = 2.0 * q1;
+   const double x4 = 2.0 * q2 * q2;
+   const double x5 = 2.0 * q3 * q3 - 1.0;
+   const double x6 = q1 * x0;
+   const double x7 = 2.0 * q1 * q1;
+   m[0] = mx * (-x4 - x5) + my * (2.0 * q1 * q2 - x1) + mz * (q3 * x3 + x2);
+   m[1] = mx * (q2 * x3 + x1) + my * (-x5 - x7) + mz * (2.0 * q2 * q3 - x6);
+   H[0] = 2.0 * q1 * q3 - x2;
+   H[1] = 2.0 * q2 * q3 + x6;
+   H[2] = -x4 - x7 + 1.0;
+}
+
+
+#endif /* __EKF_KERNELS_H__ */
+
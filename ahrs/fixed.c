@@ -0,0 +1,146 @@
+
+/*
+   Fixed-Point Arithmetic Implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <errno.h>
+
+#include "fixed.h"
+
+
+/* 1 / sqrt(m) in Q2.30 at the centers of 24 intervals covering m = [1, 4): */
+static const uint32_t rsqrt_tab[24] =
+{
+   1041682578, 985333074, 937238702, 895562589, 858993459, 826566842,
+   797555404, 771398898, 747657839, 725981977, 706088274, 687745184,
+   670761200, 654976372, 640255922, 626485368, 613566757, 601415717,
+   589959130, 579133272, 568882316, 559157115, 549914212, 541115017
+};
+
+
+/* returns y in Q2.30 with 1 / sqrt(x) = y * 2 ^ exp, x > 0: */
+static uint32_t rsqrt_norm(uint64_t x, int *exp)
+{
+   /* x = m * 2 ^ (62 - s) with m in [1, 4) and s even: */
+   int s = __builtin_clzll(x) & ~1;
+   uint64_t m = (x << s) >> 32;
+   uint64_t y = rsqrt_tab[(m >> 27) - 8];
+
+   /* newton iterations y = y * (3 - m * y ^ 2) / 2, the table is accurate to 3%: */
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      uint64_t t = (((m * y) >> 30) * y) >> 30;
+      y = (y * ((3ULL << 30) - t)) >> 31;
+   }
+   *exp = s / 2 - 61;
+   return y;
+}
+
+
+static int64_t shift_round(int64_t x, int shift)
+{
+   if (shift <= 0)
+   {
+      return x * ((int64_t)1 << -shift); /* x may be negative */
+   }
+   return (x + ((int64_t)1 << (shift - 1))) >> shift;
+}
+
+
+fix_t fix_sqrt(int64_t x)
+{
+   if (x <= 0)
+   {
+      return 0;
+   }
+   /* digit by digit, the square root of the 2 * FIX_FRAC number is the FIX_FRAC result: */
+   uint64_t rem = x;
+   uint64_t res = 0;
+   uint64_t bit = 1ULL << 62;
+   while (bit > rem)
+   {
+      bit >>= 2;
+   }
+   while (bit != 0)
+   {
+      if (rem >= res + bit)
+      {
+         rem -= res + bit;
+         res = (res >> 1) + bit;
+      }
+      else
+      {
+         res >>= 1;
+      }
+      bit >>= 2;
+   }
+   return fix_sat(res);
+}
+
+
+fix_t fix_rsqrt(fix_t x)
+{
+   if (x <= 0)
+   {
+      return FIX_MAX;
+   }
+   int exp;
+   uint32_t y = rsqrt_norm(x, &exp);
+   /* 1 / sqrt(x / 2 ^ F) * 2 ^ F = y * 2 ^ (exp + 3 / 2 * F): */
+   int shift = exp + FIX_FRAC + FIX_FRAC / 2;
+   if (shift > 0)
+   {
+      return fix_sat(y > (uint32_t)FIX_MAX >> shift ? (int64_t)FIX_MAX + 1 : (int64_t)y << shift);
+   }
+   return fix_sat(shift_round(y, -shift));
+}
+
+
+int fix_normalize(fix_t *out, const int64_t *in, int n)
+{
+   uint64_t max = 0;
+   int i;
+   for (i = 0; i < n; i++)
+   {
+      uint64_t mag = in[i] < 0 ? -(uint64_t)in[i] : (uint64_t)in[i];
+      max = mag > max ? mag : max;
+   }
+   if (max == 0)
+   {
+      return -EDOM;
+   }
+
+   /* keep 30 significant bits, so that the sum of squares fits into 64 bits: */
+   int shift = 63 - __builtin_clzll(max) - 29;
+   int64_t w[4];
+   uint64_t sum = 0;
+   for (i = 0; i < n; i++)
+   {
+      w[i] = shift >= 0 ? in[i] >> shift : in[i] * ((int64_t)1 << -shift);
+      sum += w[i] * w[i];
+   }
+
+   /* w * y < 2 ^ 60: */
+   int exp;
+   uint32_t y = rsqrt_norm(sum, &exp);
+   for (i = 0; i < n; i++)
+   {
+      out[i] = fix_sat(shift_round(w[i] * y, -(exp + FIX_FRAC)));
+   }
+   return 0;
+}
+
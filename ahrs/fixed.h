@@ -0,0 +1,88 @@
+
+/*
+   Fixed-Point Arithmetic Interface
+
+   Signed Q7.24 numbers for targets without FPU: the range of +-128
+   covers gyro rates of +-7000 deg/s, the resolution of 6e-8 matches
+   single precision floats around 1. All operations saturate instead
+   of wrapping around.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __FIXED_H__
+#define __FIXED_H__
+
+
+#include <stdint.h>
+
+
+#define FIX_FRAC 24 /* fraction bits, must be even */
+#define FIX_ONE ((fix_t)1 << FIX_FRAC)
+#define FIX_MAX INT32_MAX
+#define FIX_MIN INT32_MIN
+
+/* converts a constant, e.g. FIX(0.5), evaluated by the compiler: */
+#define FIX(x) ((fix_t)((x) * FIX_ONE + ((x) >= 0 ? 0.5 : -0.5)))
+
+
+typedef int32_t fix_t;
+
+
+/* the basic operations are inlined, they are the bulk of the filter work: */
+
+static inline fix_t fix_sat(int64_t x)
+{
+   return x > FIX_MAX ? FIX_MAX : (x < FIX_MIN ? FIX_MIN : (fix_t)x);
+}
+
+
+static inline fix_t fix_add(fix_t a, fix_t b)
+{
+   return fix_sat((int64_t)a + b);
+}
+
+
+static inline fix_t fix_sub(fix_t a, fix_t b)
+{
+   return fix_sat((int64_t)a - b);
+}
+
+
+/* rounds a product or a sum of products, which have 2 * FIX_FRAC fraction bits: */
+static inline fix_t fix_round(int64_t x)
+{
+   return fix_sat((x + ((int64_t)1 << (FIX_FRAC - 1))) >> FIX_FRAC);
+}
+
+
+static inline fix_t fix_mul(fix_t a, fix_t b)
+{
+   return fix_round((int64_t)a * b);
+}
+
+
+/* returns the square root of x, which has 2 * FIX_FRAC fraction bits: */
+fix_t fix_sqrt(int64_t x);
+
+/* returns 1 / sqrt(x) for x > 0 and FIX_MAX otherwise */
+fix_t fix_rsqrt(fix_t x);
+
+/* scales the n <= 4 components of in, which may have any common number of fraction
+   bits, to a unit vector; returns -EDOM for a zero vector, leaving out unchanged */
+int fix_normalize(fix_t *out, const int64_t *in, int n);
+
+
+#endif /* __FIXED_H__ */
+
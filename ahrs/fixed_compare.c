@@ -0,0 +1,190 @@
+
+/*
+   Fixed-Point AHRS Accuracy Comparison
+
+   Feeds the same quantized sensor readings of a synthetic motion into the
+   float and the fixed-point filters and prints the angle between their
+   attitude estimates. Most of the remaining difference comes from the
+   approximate inv_sqrt of the float filters; with 1 / sqrtf the estimates
+   agree within 0.01 degrees. Build with:
+   gcc -std=gnu99 ahrs/fixed_compare.c ahrs/fixed.c ahrs/madgwick_fixed.c ahrs/mahony_fixed.c
+       ahrs/madgwick_ahrs.c ahrs/mahony_ahrs.c ahrs/util.c -lm
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <stdio.h>
+#include <math.h>
+
+#include "madgwick_ahrs.h"
+#include "mahony_ahrs.h"
+#include "madgwick_fixed.h"
+#include "mahony_fixed.h"
+
+
+/* sensor scales of the drivers: */
+#define GYRO_SCALE (M_PI / 180.0 / 14.375) /* itg3200, rad/s per LSB */
+#define ACC_LSB_G 2048.0 /* bma180, +-4g range */
+#define MAG_LSB_G 1090.0 /* hmc5883, 1.3 Ga range */
+#define G 9.8065
+
+#define DT 0.005
+#define STEPS 200000
+
+
+typedef struct
+{
+   double max;
+   double sum_sq;
+   int n;
+}
+stats_t;
+
+
+static void stats_add(stats_t *stats, double val)
+{
+   if (val > stats->max)
+   {
+      stats->max = val;
+   }
+   stats->sum_sq += val * val;
+   stats->n++;
+}
+
+
+/* angle in degrees between two attitude quaternions: */
+static double quat_angle(const quat_t *a, const fix_t *b)
+{
+   /* the float filters normalize approximately, so both are normalized here: */
+   double fa[4] = {a->q0, a->q1, a->q2, a->q3};
+   double fb[4] = {b[0], b[1], b[2], b[3]};
+   double dot = 0.0, na = 0.0, nb = 0.0;
+   int i;
+   for (i = 0; i < 4; i++)
+   {
+      dot += fa[i] * fb[i];
+      na += fa[i] * fa[i];
+      nb += fb[i] * fb[i];
+   }
+   dot = fabs(dot) / sqrt(na * nb);
+   return 2.0 * acos(dot > 1.0 ? 1.0 : dot) * 180.0 / M_PI;
+}
+
+
+/* rotates v from the world into the body frame of the unit quaternion q: */
+static void to_body(double *out, const double *q, const double *v)
+{
+   double r[3][3] =
+   {
+      {1 - 2 * (q[2] * q[2] + q[3] * q[3]), 2 * (q[1] * q[2] + q[0] * q[3]), 2 * (q[1] * q[3] - q[0] * q[2])},
+      {2 * (q[1] * q[2] - q[0] * q[3]), 1 - 2 * (q[1] * q[1] + q[3] * q[3]), 2 * (q[2] * q[3] + q[0] * q[1])},
+      {2 * (q[1] * q[3] + q[0] * q[2]), 2 * (q[2] * q[3] - q[0] * q[1]), 1 - 2 * (q[1] * q[1] + q[2] * q[2])}
+   };
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      out[i] = r[i][0] * v[0] + r[i][1] * v[1] + r[i][2] * v[2];
+   }
+}
+
+
+static int16_t quantize(double val)
+{
+   val = floor(val + 0.5);
+   return val > INT16_MAX ? INT16_MAX : (val < INT16_MIN ? INT16_MIN : (int16_t)val);
+}
+
+
+static void print_stats(const char *name, const stats_t *stats)
+{
+   printf("%-10s max %.5f deg, rms %.5f deg\n", name, stats->max, sqrt(stats->sum_sq / stats->n));
+}
+
+
+int main(void)
+{
+   madgwick_ahrs_t madgwick;
+   mahony_ahrs_t mahony;
+   madgwick_fixed_t madgwick_fix;
+   mahony_fixed_t mahony_fix;
+   madgwick_ahrs_init(&madgwick, 0.1f);
+   mahony_ahrs_init(&mahony, 0.5f, 0.01f);
+   madgwick_fixed_init(&madgwick_fix, FIX(0.1), FIX(GYRO_SCALE), ACC_LSB_G, 0.5 * ACC_LSB_G);
+   mahony_fixed_init(&mahony_fix, FIX(0.5), FIX(0.01), FIX(GYRO_SCALE));
+
+   const double gravity[3] = {0.0, 0.0, 1.0};
+   const double field[3] = {0.2, 0.0, 0.45}; /* in gauss */
+   double q[4] = {1.0, 0.0, 0.0, 0.0};
+   stats_t madgwick_stats = {0.0, 0.0, 0};
+   stats_t mahony_stats = {0.0, 0.0, 0};
+   int step;
+   for (step = 0; step < STEPS; step++)
+   {
+      /* angular rate of the synthetic motion and its quantized measurement: */
+      double t = step * DT;
+      double w[3] = {2.0 * sin(0.7 * t), 1.5 * sin(1.1 * t + 1.0), 3.0 * sin(0.3 * t + 2.0)};
+      int16_t gyro[3], acc[3], mag[3];
+      double body_acc[3], body_mag[3];
+      int i;
+      for (i = 0; i < 3; i++)
+      {
+         gyro[i] = quantize(w[i] / GYRO_SCALE);
+      }
+      double qd[4] =
+      {
+         0.5 * (-q[1] * w[0] - q[2] * w[1] - q[3] * w[2]),
+         0.5 * (q[0] * w[0] + q[2] * w[2] - q[3] * w[1]),
+         0.5 * (q[0] * w[1] - q[1] * w[2] + q[3] * w[0]),
+         0.5 * (q[0] * w[2] + q[1] * w[1] - q[2] * w[0])
+      };
+      double norm = 0.0;
+      for (i = 0; i < 4; i++)
+      {
+         q[i] += qd[i] * DT;
+         norm += q[i] * q[i];
+      }
+      for (i = 0; i < 4; i++)
+      {
+         q[i] /= sqrt(norm);
+      }
+      to_body(body_acc, q, gravity);
+      to_body(body_mag, q, field);
+      for (i = 0; i < 3; i++)
+      {
+         acc[i] = quantize(body_acc[i] * ACC_LSB_G);
+         mag[i] = quantize(body_mag[i] * MAG_LSB_G);
+      }
+
+      /* the float filters see the same quantized readings: */
+      float g[3], a[3], m[3];
+      for (i = 0; i < 3; i++)
+      {
+         g[i] = gyro[i] * GYRO_SCALE;
+         a[i] = acc[i] * G / ACC_LSB_G;
+         m[i] = mag[i] / MAG_LSB_G;
+      }
+      madgwick_ahrs_update(&madgwick, g[0], g[1], g[2], a[0], a[1], a[2], m[0], m[1], m[2], 0.5f * G, DT);
+      mahony_ahrs_update(&mahony, g[0], g[1], g[2], a[0], a[1], a[2], m[0], m[1], m[2], DT);
+      madgwick_fixed_update(&madgwick_fix, gyro, acc, mag, FIX(DT));
+      mahony_fixed_update(&mahony_fix, gyro, acc, mag, FIX(DT));
+      stats_add(&madgwick_stats, quat_angle(&madgwick.quat, madgwick_fix.quat));
+      stats_add(&mahony_stats, quat_angle(&mahony.quat, mahony_fix.quat));
+   }
+
+   printf("%d updates at %.0f Hz, float vs. fixed-point attitude:\n", STEPS, 1.0 / DT);
+   print_stats("madgwick", &madgwick_stats);
+   print_stats("mahony", &mahony_stats);
+   return 0;
+}
+
@@ -0,0 +1,271 @@
+#!/usr/bin/env python3
+
+# Filter Kernel Generator
+#
+# Derives the Madgwick gradient steps and the EKF measurement models
+# from their symbolic definitions and writes them as C functions with
+# common subexpressions eliminated. Run it from the repository root:
+#
+#    python3 ahrs/gen_kernels.py
+#
+# The generated headers are checked in, so only changing a model needs
+# sympy (pip install sympy).
+#
+# Copyright (C) 2012 Tobias Simon
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+
+
+import os
+import re
+from sympy import symbols, Dummy, Matrix, Rational, sqrt, cse, expand, count_ops, numbered_symbols
+from sympy.printing.c import C99CodePrinter
+
+
+class KernelPrinter(C99CodePrinter):
+
+   def __init__(self, ctype):
+      C99CodePrinter.__init__(self)
+      self.suffix = '' if ctype == 'double' else 'f'
+      self.sqrt = {'double': 'sqrt', 'float': 'sqrtf', 'vf_t': 'vf_sqrt'}[ctype]
+
+   def literal(self, value):
+      return repr(float(value)) + self.suffix
+
+   def doprint(self, expr):
+      return re.sub(r'\s*\*\s*', ' * ', C99CodePrinter.doprint(self, expr))
+
+   def _print_Integer(self, expr):
+      return self.literal(expr)
+
+   def _print_Rational(self, expr):
+      return self.literal(expr)
+
+   def _print_Float(self, expr):
+      return self.literal(expr)
+
+   def _print_Pow(self, expr):
+      base, exp = expr.as_base_exp()
+      if exp == Rational(1, 2):
+         return '%s(%s)' % (self.sqrt, self._print(base))
+      if exp.is_Integer and 1 < exp <= 4:
+         return ' * '.join([self.parenthesize(base, 60)] * int(exp))
+      if exp.is_Integer and exp == -1:
+         return '%s / %s' % (self.literal(1), self.parenthesize(base, 60))
+      return C99CodePrinter._print_Pow(self, expr)
+
+
+def flops(replacements, reduced):
+   return sum(count_ops(e) for _, e in replacements) + sum(count_ops(e) for e in reduced)
+
+
+def optimize(exprs):
+   # try the model as written and fully expanded, keep the cheaper one:
+   best = None
+   for variant in (exprs, [expand(e) for e in exprs]):
+      replacements, reduced = cse(variant, symbols = numbered_symbols('x'))
+      cost = flops(replacements, reduced)
+      if best is None or cost < best[0]:
+         best = (cost, replacements, reduced)
+   return best
+
+
+def hoist_powers(replacements, reduced):
+   # the printer writes integer powers as products, so their bases have to be symbols:
+   result = []
+   def hoist(e):
+      def temp(p):
+         t = Dummy()
+         result.append((t, p.base))
+         return t ** p.exp
+      return e.replace(lambda x: x.is_Pow and x.exp.is_Integer and x.exp > 1 and not x.base.is_Atom, temp)
+   for sym, e in replacements:
+      e = hoist(e)
+      result.append((sym, e))
+   reduced = [hoist(e) for e in reduced]
+
+   # renumber the temporaries in order of definition:
+   names = dict(zip([sym for sym, _ in result], numbered_symbols('x')))
+   result = [(names[sym], e.xreplace(names)) for sym, e in result]
+   reduced = [e.xreplace(names) for e in reduced]
+   return result, reduced
+
+
+def kernel(name, comment, ctype, args, outputs):
+   '''
+   ctype: float, double or vf_t for the vector kernels of ahrs_batch_kernel.h
+   args: input symbols, passed by value
+   outputs: list of (array name, list of expressions)
+   '''
+   printer = KernelPrinter(ctype)
+   exprs = [e for _, out in outputs for e in out]
+   cost, replacements, reduced = optimize(exprs)
+   replacements, reduced = hoist_powers(replacements, reduced)
+   params = ['%s %s[%d]' % (ctype, o, len(out)) for o, out in outputs]
+   params += ['%s %s' % (ctype, a) for a in args]
+   lines = ['/* %s, %d operations: */' % (comment, cost)]
+   if ctype == 'vf_t':
+      lines.append('static inline TARGET void KERNEL(%s)(%s)' % (name, ', '.join(params)))
+   else:
+      lines.append('static inline void %s(%s)' % (name, ', '.join(params)))
+   lines.append('{')
+   for sym, e in replacements:
+      lines.append('   const %s %s = %s;' % (ctype, sym, printer.doprint(e)))
+   i = 0
+   for o, out in outputs:
+      for j in range(len(out)):
+         lines.append('   %s[%d] = %s;' % (o, j, printer.doprint(reduced[i])))
+         i += 1
+   lines.append('}')
+   return '\n'.join(lines)
+
+
+HEADER = '''
+/*
+   %s
+
+   Generated by ahrs/gen_kernels.py, do not edit.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef %s
+#define %s
+
+
+%s
+
+
+#endif /* %s */
+
+'''
+
+
+TEMPLATE = '''
+/*
+   %s
+
+   Included by ahrs_batch_kernel.h once per instruction set, see there.
+
+   Generated by ahrs/gen_kernels.py, do not edit.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+%s
+
+'''
+
+
+def write_header(path, title, kernels, template = False):
+   if template:
+      text = TEMPLATE % (title, '\n\n\n'.join(kernels))
+   else:
+      guard = '__%s__' % os.path.basename(path).replace('.', '_').upper()
+      text = HEADER % (title, guard, guard, '\n\n\n'.join(kernels), guard)
+   with open(path, 'w') as f:
+      f.write(text)
+
+
+q0, q1, q2, q3 = symbols('q0 q1 q2 q3')
+ax, ay, az = symbols('ax ay az')
+mx, my, mz = symbols('mx my mz')
+q = (q0, q1, q2, q3)
+
+
+def rot(q0, q1, q2, q3):
+   '''rotation matrix of the unit quaternion, from body into reference frame'''
+   return Matrix([
+      [1 - 2 * (q2 ** 2 + q3 ** 2), 2 * (q1 * q2 - q0 * q3), 2 * (q1 * q3 + q0 * q2)],
+      [2 * (q1 * q2 + q0 * q3), 1 - 2 * (q1 ** 2 + q3 ** 2), 2 * (q2 * q3 - q0 * q1)],
+      [2 * (q1 * q3 - q0 * q2), 2 * (q2 * q3 + q0 * q1), 1 - 2 * (q1 ** 2 + q2 ** 2)]])
+
+
+def madgwick_kernels(ctype):
+   '''
+   gradient J^T * f of Madgwick's objective functions, see his report, eq. (25) - (34);
+   here the accelerometer measures the negative gravity direction, so its residual is
+   the expected minus the negative measured direction
+   '''
+   R = rot(*q)
+   f_g = R.T * Matrix([0, 0, 1]) + Matrix([ax, ay, az])
+   imu = (f_g.jacobian(q).T * f_g)
+
+   # the reference field (bx, 0, bz) is the measured one rotated into the earth frame,
+   # with the inclination kept; Madgwick's code writes 2 * bx for it:
+   _2bx, _2bz = symbols('_2bx _2bz')
+   Rh = Matrix([
+      [q0 ** 2 + q1 ** 2 - q2 ** 2 - q3 ** 2, 2 * (q1 * q2 - q0 * q3), 2 * (q1 * q3 + q0 * q2)],
+      [2 * (q1 * q2 + q0 * q3), q0 ** 2 - q1 ** 2 + q2 ** 2 - q3 ** 2, 2 * (q2 * q3 - q0 * q1)],
+      [2 * (q1 * q3 - q0 * q2), 2 * (q2 * q3 + q0 * q1), q0 ** 2 - q1 ** 2 - q2 ** 2 + q3 ** 2]])
+   h = Rh * Matrix([mx, my, mz])
+   f_b = Matrix([
+      _2bx * (Rational(1, 2) - q2 ** 2 - q3 ** 2) + _2bz * (q1 * q3 - q0 * q2) - mx,
+      _2bx * (q1 * q2 - q0 * q3) + _2bz * (q0 * q1 + q2 * q3) - my,
+      _2bx * (q0 * q2 + q1 * q3) + _2bz * (Rational(1, 2) - q1 ** 2 - q2 ** 2) - mz])
+   f = Matrix.vstack(f_g, f_b)
+   marg = (f.jacobian(q).T * f).subs({_2bx: sqrt(h[0] ** 2 + h[1] ** 2), _2bz: h[2]})
+
+   return [
+      kernel('madgwick_gradient_imu', 'gradient of the accelerometer objective function', ctype,
+             q + (ax, ay, az), [('s', list(imu))]),
+      kernel('madgwick_gradient_marg', 'gradient of the accelerometer and magnetometer objective function', ctype,
+             q + (ax, ay, az, mx, my, mz), [('s', list(marg))])]
+
+
+def ekf_kernels():
+   '''measurement models of the multiplicative EKF'''
+   R = rot(*q)
+
+   # expected direction h = R^T * r of the reference acceleration r in the body frame:
+   rx, ry, rz = symbols('rx ry rz')
+   h = R.T * Matrix([rx, ry, rz])
+
+   # horizontal components of the field m rotated into the reference frame
+   # and the jacobian of the heading error, the vertical axis in the body frame:
+   m = R * Matrix([mx, my, mz])
+
+   return [
+      kernel('ekf_acc_model', 'expected acceleration direction in the body frame', 'double',
+             q + (rx, ry, rz), [('h', list(h))]),
+      kernel('ekf_mag_model', 'horizontal reference frame field and heading jacobian', 'double',
+             q + (mx, my, mz), [('m', [m[0], m[1]]), ('H', list(R[2, :]))])]
+
+
+if __name__ == '__main__':
+   base = os.path.dirname(os.path.abspath(__file__))
+   write_header(os.path.join(base, 'madgwick_kernels.h'), 'Madgwick Gradient Step Kernels', madgwick_kernels('float'))
+   write_header(os.path.join(base, 'madgwick_batch_kernels.h'), 'Madgwick Gradient Step Vector Kernels', madgwick_kernels('vf_t'), True)
+   write_header(os.path.join(base, 'ekf_kernels.h'), 'EKF Measurement Model Kernels', ekf_kernels())
+
@@ -0,0 +1,206 @@
+
+/*
+   Gyro Bias Estimator Implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <string.h>
+#include <math.h>
+
+#include "gyro_bias.h"
+
+
+static void window_init(gyro_bias_window_t *wnd, int size)
+{
+   memset(wnd, 0, sizeof(gyro_bias_window_t));
+   wnd->size = size > GYRO_BIAS_MAX_WINDOW ? GYRO_BIAS_MAX_WINDOW : size;
+}
+
+
+static void window_add(gyro_bias_window_t *wnd, const vec3_t *val)
+{
+   if (wnd->size == 0)
+   {
+      return;
+   }
+   if (wnd->len == 0)
+   {
+      wnd->ref = *val;
+   }
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      if (wnd->len == wnd->size)
+      {
+         double old = wnd->hist[wnd->pos].vec[i] - wnd->ref.vec[i];
+         wnd->sum[i] -= old;
+         wnd->sum_sq[i] -= old * old;
+      }
+      double d = val->vec[i] - wnd->ref.vec[i];
+      wnd->sum[i] += d;
+      wnd->sum_sq[i] += d * d;
+   }
+   wnd->hist[wnd->pos] = *val;
+   wnd->pos = (wnd->pos + 1) % wnd->size;
+   if (wnd->len < wnd->size)
+   {
+      wnd->len++;
+   }
+   else if (wnd->pos == 0)
+   {
+      /* recompute the sums once per window, so rounding errors do not accumulate: */
+      memset(wnd->sum, 0, sizeof(wnd->sum));
+      memset(wnd->sum_sq, 0, sizeof(wnd->sum_sq));
+      int j;
+      for (j = 0; j < wnd->size; j++)
+      {
+         for (i = 0; i < 3; i++)
+         {
+            double d = wnd->hist[j].vec[i] - wnd->ref.vec[i];
+            wnd->sum[i] += d;
+            wnd->sum_sq[i] += d * d;
+         }
+      }
+   }
+}
+
+
+/* variance summed over all axes: */
+static double window_var(const gyro_bias_window_t *wnd)
+{
+   double var = 0.0;
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      double mean = wnd->sum[i] / wnd->len;
+      var += wnd->sum_sq[i] / wnd->len - mean * mean;
+   }
+   return var;
+}
+
+
+static int window_full(const gyro_bias_window_t *wnd)
+{
+   return wnd->size > 0 && wnd->len == wnd->size;
+}
+
+
+/* all axes of a and b differ by at most max: */
+static int within(const vec3_t *a, const vec3_t *b, float max)
+{
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      if (fabs(a->vec[i] - b->vec[i]) > max)
+      {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+
+void gyro_bias_init(gyro_bias_t *bias, int gyro_window, int acc_window, float gyro_var, float acc_var, int tau, float max_drift, int confirm)
+{
+   window_init(&bias->gyro, gyro_window);
+   window_init(&bias->acc, acc_window);
+   bias->gyro_var = gyro_var;
+   bias->acc_var = acc_var;
+   bias->tau = tau;
+   bias->max_drift = max_drift;
+   bias->confirm = confirm;
+   bias->offset_len = 0;
+   bias->updates = 0;
+   bias->still = 0;
+   memset(&bias->bias, 0, sizeof(bias->bias));
+}
+
+
+void gyro_bias_add_acc(gyro_bias_t *bias, const vec3_t *acc)
+{
+   window_add(&bias->acc, acc);
+}
+
+
+void gyro_bias_update(gyro_bias_t *bias, vec3_t *out, const vec3_t *gyro)
+{
+   window_add(&bias->gyro, gyro);
+
+   /* at rest, both sensors only show noise: */
+   bias->still = window_full(&bias->gyro) && window_var(&bias->gyro) < bias->gyro_var
+                 && (bias->acc.size == 0 || (window_full(&bias->acc) && window_var(&bias->acc) < bias->acc_var));
+   if (!bias->still)
+   {
+      bias->offset_len = 0;
+   }
+   else
+   {
+      vec3_t mean;
+      int i;
+      for (i = 0; i < 3; i++)
+      {
+         mean.vec[i] = bias->gyro.ref.vec[i] + bias->gyro.sum[i] / bias->gyro.len;
+      }
+
+      /* a steady rotation is as quiet as rest, but its mean is off the known bias;
+         a new bias (drift while moving, or a rotation during the first estimate)
+         stays put for several windows: */
+      if (bias->updates > 0 && !within(&mean, &bias->bias, bias->max_drift))
+      {
+         if (bias->offset_len == 0 || !within(&mean, &bias->offset, bias->max_drift))
+         {
+            bias->offset = mean;
+            bias->offset_len = 0;
+         }
+         bias->offset_len++;
+         if (bias->offset_len < bias->confirm * bias->gyro.size)
+         {
+            bias->still = 0;
+         }
+         else
+         {
+            /* start over with averaging: */
+            bias->updates = 0;
+            bias->offset_len = 0;
+         }
+      }
+      else
+      {
+         bias->offset_len = 0;
+      }
+
+      if (bias->still)
+      {
+         /* average the first estimates, then follow slow drift: */
+         bias->updates++;
+         float gain = 1.0f / bias->updates;
+         if (gain < 1.0f / bias->tau)
+         {
+            gain = 1.0f / bias->tau;
+         }
+         for (i = 0; i < 3; i++)
+         {
+            bias->bias.vec[i] += gain * (mean.vec[i] - bias->bias.vec[i]);
+         }
+      }
+   }
+
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      out->vec[i] = gyro->vec[i] - bias->bias.vec[i];
+   }
+}
+
@@ -0,0 +1,85 @@
+
+/*
+   Gyro Bias Estimator Interface
+
+   Detects stillness from the variance of gyro and accelerometer
+   samples over sliding windows and refines the gyro bias whenever
+   the vehicle is at rest, so thermal drift is tracked during
+   operation without a blocking calibration at startup.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __GYRO_BIAS_H__
+#define __GYRO_BIAS_H__
+
+
+#include "../util/math.h"
+
+
+/* maximum window size in samples: */
+#define GYRO_BIAS_MAX_WINDOW 1024
+
+
+/* sliding window of vectors with running sums: */
+typedef struct
+{
+   vec3_t hist[GYRO_BIAS_MAX_WINDOW];
+   int size;
+   int len; /* number of samples in the window */
+   int pos; /* next slot to write */
+   vec3_t ref; /* subtracted from the sums to avoid cancellation */
+   double sum[3];
+   double sum_sq[3];
+}
+gyro_bias_window_t;
+
+
+typedef struct
+{
+   gyro_bias_window_t gyro;
+   gyro_bias_window_t acc;
+
+   /* stillness thresholds, summed variance over all axes: */
+   float gyro_var; /* in (rad/s)^2 */
+   float acc_var; /* in (m/s^2)^2 */
+
+   int tau; /* time constant of the bias refinement in gyro samples */
+   float max_drift; /* largest difference between window mean and bias refined right away, in rad/s */
+   int confirm; /* number of windows a larger difference has to persist to replace the bias */
+   vec3_t offset; /* window mean off the bias, waiting for confirmation */
+   int offset_len; /* number of consecutive still samples consistent with it */
+   int updates; /* number of bias refinements */
+   int still; /* result of the last stillness test */
+   vec3_t bias; /* in rad/s */
+}
+gyro_bias_t;
+
+
+/* window sizes in samples of each sensor, at most GYRO_BIAS_MAX_WINDOW;
+   the window should cover about a second; once the bias is known, a window
+   mean more than max_drift off is taken as a steady rotation, unless it stays
+   within max_drift for confirm windows, then it replaces the bias */
+void gyro_bias_init(gyro_bias_t *bias, int gyro_window, int acc_window, float gyro_var, float acc_var, int tau, float max_drift, int confirm);
+
+/* adds a fresh accelerometer sample in m/s^2 */
+void gyro_bias_add_acc(gyro_bias_t *bias, const vec3_t *acc);
+
+/* adds a fresh gyro sample in rad/s, refines the bias if the vehicle
+   is at rest and returns the bias-corrected rate in out */
+void gyro_bias_update(gyro_bias_t *bias, vec3_t *out, const vec3_t *gyro);
+
+
+#endif /* __GYRO_BIAS_H__ */
+
@@ -17,6 +17,7 @@
 #include <stdio.h>
 #include "util.h"
 #include "madgwick_ahrs.h"
+#include "madgwick_kernels.h"
 
 
 void madgwick_ahrs_init(madgwick_ahrs_t *ahrs, float beta)
@@ -35,9 +36,8 @@ static void madgwick_ahrs_update_imu(madgwick_ahrs_t *ahrs,
                            float accelCutoff, float dt)
 {
 	float accelSquareSum, recipNorm;
-	float s0, s1, s2, s3;
+	float s[4];
 	float qDot0, qDot1, qDot2, qDot3;
-	float _2q0, _2q1, _2q2, _2q3, _4q0, _4q1, _4q2 ,_8q1, _8q2, q0q0, q1q1, q2q2, q3q3;
 
 	// Rate of change of quaternion from gyroscope
 	qDot0 = 0.5f * (-ahrs->quat.q1 * gx - ahrs->quat.q2 * gy - ahrs->quat.q3 * gz);
@@ -57,38 +57,20 @@ static void madgwick_ahrs_update_imu(madgwick_ahrs_t *ahrs,
 		ay *= recipNorm;
 		az *= recipNorm;
 
-		// Auxiliary variables to avoid repeated arithmetic
-		_2q0 = 2.0f * ahrs->quat.q0;
-		_2q1 = 2.0f * ahrs->quat.q1;
-		_2q2 = 2.0f * ahrs->quat.q2;
-		_2q3 = 2.0f * ahrs->quat.q3;
-		_4q0 = 4.0f * ahrs->quat.q0;
-		_4q1 = 4.0f * ahrs->quat.q1;
-		_4q2 = 4.0f * ahrs->quat.q2;
-		_8q1 = 8.0f * ahrs->quat.q1;
-		_8q2 = 8.0f * ahrs->quat.q2;
-		q0q0 = ahrs->quat.q0 * ahrs->quat.q0;
-		q1q1 = ahrs->quat.q1 * ahrs->quat.q1;
-		q2q2 = ahrs->quat.q2 * ahrs->quat.q2;
-		q3q3 = ahrs->quat.q3 * ahrs->quat.q3;
-
 		// Gradient decent algorithm corrective step
-		s0 = _4q0 * q2q2 - _2q2 * ax + _4q0 * q1q1 + _2q1 * ay;
-		s1 = _4q1 * q3q3 + _2q3 * ax + 4.0f * q0q0 * ahrs->quat.q1 + _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 - _4q1 * az;
-		s2 = 4.0f * q0q0 * ahrs->quat.q2 - _2q0 * ax + _4q2 * q3q3 + _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 - _4q2 * az;
-		s3 = 4.0f * q1q1 * ahrs->quat.q3 + _2q1 * ax + 4.0f * q2q2 * ahrs->quat.q3 + _2q2 * ay;
-
-		recipNorm = inv_sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
-		s0 *= recipNorm;
-		s1 *= recipNorm;
-		s2 *= recipNorm;
-		s3 *= recipNorm;
+		madgwick_gradient_imu(s, ahrs->quat.q0, ahrs->quat.q1, ahrs->quat.q2, ahrs->quat.q3, ax, ay, az);
+
+		recipNorm = inv_sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2] + s[3] * s[3]); // normalise step magnitude
+		s[0] *= recipNorm;
+		s[1] *= recipNorm;
+		s[2] *= recipNorm;
+		s[3] *= recipNorm;
 	   
       // Apply feedback step
-	   qDot0 -= ahrs->beta * s0;
-	   qDot1 -= ahrs->beta * s1;
-	   qDot2 -= ahrs->beta * s2;
-	   qDot3 -= ahrs->beta * s3;
+	   qDot0 -= ahrs->beta * s[0];
+	   qDot1 -= ahrs->beta * s[1];
+	   qDot2 -= ahrs->beta * s[2];
+	   qDot3 -= ahrs->beta * s[3];
 	}
 
 	// Integrate rate of change of quaternion to yield quaternion
@@ -116,12 +98,8 @@ void madgwick_ahrs_update(madgwick_ahrs_t *ahrs, float gx, float gy, float gz,
 
 
 	float accelSquareSum, recipNorm;
-	float s0, s1, s2, s3;
+	float s[4];
 	float qDot0, qDot1, qDot2, qDot3;
-	float hx, hy;
-	float _2q0mx, _2q0my, _2q0mz, _2q1mx, _2bx, _2bz, _4bx, _4bz;
-	float _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3;
-	float q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
 
 	// Use IMU algorithm if magnetometer measurement invalid (avoids NaN in magnetometer normalisation) or
 	// mag data has not been updated
@@ -158,53 +136,20 @@ void madgwick_ahrs_update(madgwick_ahrs_t *ahrs, float gx, float gy, float gz,
 		my *= recipNorm;
 		mz *= recipNorm;
 
-		// Auxiliary variables to avoid repeated arithmetic
-		_2q0mx = 2.0f * ahrs->quat.q0 * mx;
-		_2q0my = 2.0f * ahrs->quat.q0 * my;
-		_2q0mz = 2.0f * ahrs->quat.q0 * mz;
-		_2q1mx = 2.0f * ahrs->quat.q1 * mx;
-		_2q0   = 2.0f * ahrs->quat.q0;
-		_2q1   = 2.0f * ahrs->quat.q1;
-		_2q2   = 2.0f * ahrs->quat.q2;
-		_2q3   = 2.0f * ahrs->quat.q3;
-		_2q0q2 = 2.0f * ahrs->quat.q0 * ahrs->quat.q2;
-		_2q2q3 = 2.0f * ahrs->quat.q2 * ahrs->quat.q3;
-		q0q0   =   ahrs->quat.q0 * ahrs->quat.q0;
-		q0q1   =   ahrs->quat.q0 * ahrs->quat.q1;
-		q0q2   =   ahrs->quat.q0 * ahrs->quat.q2;
-		q0q3   =   ahrs->quat.q0 * ahrs->quat.q3;
-		q1q1   =   ahrs->quat.q1 * ahrs->quat.q1;
-		q1q2   =   ahrs->quat.q1 * ahrs->quat.q2;
-		q1q3   =   ahrs->quat.q1 * ahrs->quat.q3;
-		q2q2   =   ahrs->quat.q2 * ahrs->quat.q2;
-		q2q3   =   ahrs->quat.q2 * ahrs->quat.q3;
-		q3q3   =   ahrs->quat.q3 * ahrs->quat.q3;
-
-		// Reference direction of Earth's magnetic field
-		hx   = mx * q0q0 - _2q0my * ahrs->quat.q3 + _2q0mz * ahrs->quat.q2 + mx * q1q1 + _2q1 * my * ahrs->quat.q2 + _2q1 * mz * ahrs->quat.q3 - mx * q2q2 - mx * q3q3;
-		hy   = _2q0mx * ahrs->quat.q3 + my * q0q0 - _2q0mz * ahrs->quat.q1 + _2q1mx * ahrs->quat.q2 - my * q1q1 + my * q2q2 + _2q2 * mz * ahrs->quat.q3 - my * q3q3;
-      _2bx = sqrt(hx * hx + hy * hy);
-		_2bz = -_2q0mx * ahrs->quat.q2 + _2q0my * ahrs->quat.q1 + mz * q0q0 + _2q1mx * ahrs->quat.q3 - mz * q1q1 + _2q2 * my * ahrs->quat.q3 - mz * q2q2 + mz * q3q3;
-		_4bx = 2.0f * _2bx;
-		_4bz = 2.0f * _2bz;
-
 		// Gradient decent algorithm corrective step
-		s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 + ax) + _2q1 * (2.0f * q0q1 + _2q2q3 + ay) - _2bz * ahrs->quat.q2 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * ahrs->quat.q3 + _2bz * ahrs->quat.q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * ahrs->quat.q2 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-		s1 =  _2q3 * (2.0f * q1q3 - _2q0q2 + ax) + _2q0 * (2.0f * q0q1 + _2q2q3 + ay) - 4.0f * ahrs->quat.q1 * (1 - 2.0f * q1q1 - 2.0f * q2q2 + az) + _2bz * ahrs->quat.q3 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * ahrs->quat.q2 + _2bz * ahrs->quat.q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * ahrs->quat.q3 - _4bz * ahrs->quat.q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-		s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 + ax) + _2q3 * (2.0f * q0q1 + _2q2q3 + ay) - 4.0f * ahrs->quat.q2 * (1 - 2.0f * q1q1 - 2.0f * q2q2 + az) + (-_4bx * ahrs->quat.q2 - _2bz * ahrs->quat.q0) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * ahrs->quat.q1 + _2bz * ahrs->quat.q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * ahrs->quat.q0 - _4bz * ahrs->quat.q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-		s3 =  _2q1 * (2.0f * q1q3 - _2q0q2 + ax) + _2q2 * (2.0f * q0q1 + _2q2q3 + ay) + (-_4bx * ahrs->quat.q3 + _2bz * ahrs->quat.q1) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * ahrs->quat.q0 + _2bz * ahrs->quat.q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * ahrs->quat.q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+		madgwick_gradient_marg(s, ahrs->quat.q0, ahrs->quat.q1, ahrs->quat.q2, ahrs->quat.q3, ax, ay, az, mx, my, mz);
 
-		recipNorm = inv_sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
-		s0 *= recipNorm;
-		s1 *= recipNorm;
-		s2 *= recipNorm;
-		s3 *= recipNorm;
+		recipNorm = inv_sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2] + s[3] * s[3]); // normalise step magnitude
+		s[0] *= recipNorm;
+		s[1] *= recipNorm;
+		s[2] *= recipNorm;
+		s[3] *= recipNorm;
 
 		// Apply feedback step
-		qDot0 -= ahrs->beta * s0;
-		qDot1 -= ahrs->beta * s1;
-		qDot2 -= ahrs->beta * s2;
-		qDot3 -= ahrs->beta * s3;
+		qDot0 -= ahrs->beta * s[0];
+		qDot1 -= ahrs->beta * s[1];
+		qDot2 -= ahrs->beta * s[2];
+		qDot3 -= ahrs->beta * s[3];
 	}
 
 	// Integrate rate of change of quaternion to yield quaternion
@@ -0,0 +1,161 @@
+
+/*
+   Fixed-Point Madgwick AHRS Implementation
+
+   The gradient of the objective function is computed in its factored
+   form J' * f, which is the same as the expanded expressions of
+   madgwick_ahrs.c; sums of products are accumulated with 48 fraction
+   bits and rounded once.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <stddef.h>
+
+#include "madgwick_fixed.h"
+
+
+#define ONE2 ((int64_t)1 << (2 * FIX_FRAC)) /* 1.0 as a product */
+
+
+void madgwick_fixed_init(madgwick_fixed_t *ahrs, fix_t beta, fix_t gyro_scale, int32_t acc_norm, int32_t acc_cutoff)
+{
+   ahrs->beta = beta;
+   ahrs->gyro_scale = gyro_scale;
+   ahrs->acc_norm = acc_norm;
+   ahrs->acc_cutoff = acc_cutoff;
+   ahrs->quat[0] = FIX_ONE;
+   ahrs->quat[1] = 0;
+   ahrs->quat[2] = 0;
+   ahrs->quat[3] = 0;
+}
+
+
+/* the magnitude of the acceleration is within acc_norm +- acc_cutoff: */
+static int acc_valid(const madgwick_fixed_t *ahrs, const int16_t *acc)
+{
+   int64_t sq = (int64_t)acc[0] * acc[0] + (int64_t)acc[1] * acc[1] + (int64_t)acc[2] * acc[2];
+   int64_t lo = ahrs->acc_norm - ahrs->acc_cutoff;
+   int64_t hi = ahrs->acc_norm + ahrs->acc_cutoff;
+   return sq < hi * hi && (lo < 0 || sq > lo * lo);
+}
+
+
+/* normalizes raw sensor values, returns -EDOM for a zero vector: */
+static int normalize_raw(fix_t *out, const int16_t *raw)
+{
+   int64_t in[3] = {raw[0], raw[1], raw[2]};
+   return fix_normalize(out, in, 3);
+}
+
+
+/* accumulates the corrective step s of the magnetometer: */
+static void mag_step(int64_t *s, const fix_t *q, const fix_t *m)
+{
+   fix_t q0q0 = fix_mul(q[0], q[0]);
+   fix_t q0q1 = fix_mul(q[0], q[1]);
+   fix_t q0q2 = fix_mul(q[0], q[2]);
+   fix_t q0q3 = fix_mul(q[0], q[3]);
+   fix_t q1q1 = fix_mul(q[1], q[1]);
+   fix_t q1q2 = fix_mul(q[1], q[2]);
+   fix_t q1q3 = fix_mul(q[1], q[3]);
+   fix_t q2q2 = fix_mul(q[2], q[2]);
+   fix_t q2q3 = fix_mul(q[2], q[3]);
+   fix_t q3q3 = fix_mul(q[3], q[3]);
+
+   /* reference direction of Earth's magnetic field: */
+   fix_t hx = fix_round((int64_t)m[0] * (q0q0 + q1q1 - q2q2 - q3q3) + 2 * ((int64_t)m[1] * (q1q2 - q0q3) + (int64_t)m[2] * (q0q2 + q1q3)));
+   fix_t hy = fix_round((int64_t)m[1] * (q0q0 - q1q1 + q2q2 - q3q3) + 2 * ((int64_t)m[0] * (q0q3 + q1q2) + (int64_t)m[2] * (q2q3 - q0q1)));
+   fix_t _2bx = fix_sqrt((int64_t)hx * hx + (int64_t)hy * hy);
+   fix_t _2bz = fix_round((int64_t)m[2] * (q0q0 - q1q1 - q2q2 + q3q3) + 2 * ((int64_t)m[0] * (q1q3 - q0q2) + (int64_t)m[1] * (q0q1 + q2q3)));
+
+   /* objective function: */
+   fix_t f4 = fix_round((int64_t)_2bx * (FIX(0.5) - q2q2 - q3q3) + (int64_t)_2bz * (q1q3 - q0q2) - (int64_t)m[0] * FIX_ONE);
+   fix_t f5 = fix_round((int64_t)_2bx * (q1q2 - q0q3) + (int64_t)_2bz * (q0q1 + q2q3) - (int64_t)m[1] * FIX_ONE);
+   fix_t f6 = fix_round((int64_t)_2bx * (q0q2 + q1q3) + (int64_t)_2bz * (FIX(0.5) - q1q1 - q2q2) - (int64_t)m[2] * FIX_ONE);
+
+   /* jacobian: */
+   fix_t _2bxq0 = fix_mul(_2bx, q[0]);
+   fix_t _2bxq1 = fix_mul(_2bx, q[1]);
+   fix_t _2bxq2 = fix_mul(_2bx, q[2]);
+   fix_t _2bxq3 = fix_mul(_2bx, q[3]);
+   fix_t _2bzq0 = fix_mul(_2bz, q[0]);
+   fix_t _2bzq1 = fix_mul(_2bz, q[1]);
+   fix_t _2bzq2 = fix_mul(_2bz, q[2]);
+   fix_t _2bzq3 = fix_mul(_2bz, q[3]);
+   s[0] += -(int64_t)_2bzq2 * f4 + (int64_t)(_2bzq1 - _2bxq3) * f5 + (int64_t)_2bxq2 * f6;
+   s[1] += (int64_t)_2bzq3 * f4 + (int64_t)(_2bxq2 + _2bzq0) * f5 + (int64_t)(_2bxq3 - 2 * _2bzq1) * f6;
+   s[2] += -(int64_t)(2 * _2bxq2 + _2bzq0) * f4 + (int64_t)(_2bxq1 + _2bzq3) * f5 + (int64_t)(_2bxq0 - 2 * _2bzq2) * f6;
+   s[3] += (int64_t)(_2bzq1 - 2 * _2bxq3) * f4 + (int64_t)(_2bzq2 - _2bxq0) * f5 + (int64_t)_2bxq1 * f6;
+}
+
+
+void madgwick_fixed_update(madgwick_fixed_t *ahrs, const int16_t *gyro, const int16_t *acc, const int16_t *mag, fix_t dt)
+{
+   fix_t *q = ahrs->quat;
+   int i;
+
+   /* rate of change of quaternion from gyroscope: */
+   fix_t g[3];
+   for (i = 0; i < 3; i++)
+   {
+      g[i] = fix_sat((int64_t)gyro[i] * ahrs->gyro_scale);
+   }
+   fix_t qDot[4];
+   qDot[0] = fix_round((-(int64_t)q[1] * g[0] - (int64_t)q[2] * g[1] - (int64_t)q[3] * g[2]) / 2);
+   qDot[1] = fix_round(( (int64_t)q[0] * g[0] + (int64_t)q[2] * g[2] - (int64_t)q[3] * g[1]) / 2);
+   qDot[2] = fix_round(( (int64_t)q[0] * g[1] - (int64_t)q[1] * g[2] + (int64_t)q[3] * g[0]) / 2);
+   qDot[3] = fix_round(( (int64_t)q[0] * g[2] + (int64_t)q[1] * g[1] - (int64_t)q[2] * g[0]) / 2);
+
+   /* compute feedback only if the accelerometer measures about gravity: */
+   fix_t a[3];
+   if (acc_valid(ahrs, acc) && normalize_raw(a, acc) == 0)
+   {
+      /* objective function and jacobian of the gravity direction: */
+      fix_t f1 = fix_round(2 * ((int64_t)q[1] * q[3] - (int64_t)q[0] * q[2]) + (int64_t)a[0] * FIX_ONE);
+      fix_t f2 = fix_round(2 * ((int64_t)q[0] * q[1] + (int64_t)q[2] * q[3]) + (int64_t)a[1] * FIX_ONE);
+      fix_t f3 = fix_round(ONE2 - 2 * ((int64_t)q[1] * q[1] + (int64_t)q[2] * q[2]) + (int64_t)a[2] * FIX_ONE);
+      int64_t s[4];
+      s[0] = 2 * (-(int64_t)q[2] * f1 + (int64_t)q[1] * f2);
+      s[1] = 2 * ((int64_t)q[3] * f1 + (int64_t)q[0] * f2) - 4 * (int64_t)q[1] * f3;
+      s[2] = 2 * (-(int64_t)q[0] * f1 + (int64_t)q[3] * f2) - 4 * (int64_t)q[2] * f3;
+      s[3] = 2 * ((int64_t)q[1] * f1 + (int64_t)q[2] * f2);
+
+      /* the magnetometer adds its own objective function: */
+      fix_t m[3];
+      if (mag != NULL && normalize_raw(m, mag) == 0)
+      {
+         mag_step(s, q, m);
+      }
+
+      /* apply feedback step of normalized magnitude: */
+      fix_t step[4];
+      if (fix_normalize(step, s, 4) == 0)
+      {
+         for (i = 0; i < 4; i++)
+         {
+            qDot[i] = fix_sub(qDot[i], fix_mul(ahrs->beta, step[i]));
+         }
+      }
+   }
+
+   /* integrate rate of change of quaternion and normalize: */
+   int64_t qn[4];
+   for (i = 0; i < 4; i++)
+   {
+      qn[i] = fix_add(q[i], fix_mul(qDot[i], dt));
+   }
+   fix_normalize(q, qn, 4);
+}
+
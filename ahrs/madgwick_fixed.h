@@ -0,0 +1,49 @@
+
+/*
+   Fixed-Point Madgwick AHRS Interface
+
+   Integer implementation of madgwick_ahrs.c for targets without FPU,
+   updated directly from the raw register values of the sensors.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __MADGWICK_FIXED_H__
+#define __MADGWICK_FIXED_H__
+
+
+#include "fixed.h"
+
+
+typedef struct
+{
+   fix_t beta; /* gain of the gradient descent step */
+   fix_t gyro_scale; /* rad/s per gyro LSB */
+   int32_t acc_norm; /* acceleration of gravity in accelerometer LSB */
+   int32_t acc_cutoff; /* accelerometer feedback only within acc_norm +- acc_cutoff */
+   fix_t quat[4]; /* quaternion of sensor frame relative to auxiliary frame */
+}
+madgwick_fixed_t;
+
+
+void madgwick_fixed_init(madgwick_fixed_t *ahrs, fix_t beta, fix_t gyro_scale, int32_t acc_norm, int32_t acc_cutoff);
+
+/* takes the raw gyro, accelerometer and calibrated magnetometer values,
+   e.g. itg3200_dev_t.adc; a zero magnetometer vector selects the IMU algorithm;
+   dt in seconds */
+void madgwick_fixed_update(madgwick_fixed_t *ahrs, const int16_t *gyro, const int16_t *acc, const int16_t *mag, fix_t dt);
+
+
+#endif /* __MADGWICK_FIXED_H__ */
+
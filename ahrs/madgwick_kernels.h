@@ -0,0 +1,89 @@
+
+/*
+   Madgwick Gradient Step Kernels
+
+   Generated by ahrs/gen_kernels.py, do not edit.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __MADGWICK_KERNELS_H__
+#define __MADGWICK_KERNELS_H__
+
+
+/* gradient of the accelerometer objective function, 37 operations: */
+static inline void madgwick_gradient_imu(float s[4], float q0, float q1, float q2, float q3, float ax, float ay, float az)
+{
+   const float x0 = 2.0f * q1;
+   const float x1 = 2.0f * q2;
+   const float x2 = ay + q0 * x0 + q3 * x1;
+   const float x3 = ax - q0 * x1 + q3 * x0;
+   const float x4 = 2.0f * q0;
+   const float x5 = 4.0f * az - 8.0f * q1 * q1 - 8.0f * q2 * q2 + 4.0f;
+   s[0] = x0 * x2 - x1 * x3;
+   s[1] = -q1 * x5 + 2.0f * q3 * x3 + x2 * x4;
+   s[2] = -q2 * x5 + 2.0f * q3 * x2 - x3 * x4;
+   s[3] = x0 * x3 + x1 * x2;
+}
+
+
+/* gradient of the accelerometer and magnetometer objective function, 160 operations: */
+static inline void madgwick_gradient_marg(float s[4], float q0, float q1, float q2, float q3, float ax, float ay, float az, float mx, float my, float mz)
+{
+   const float x0 = q0 * q1;
+   const float x1 = 2.0f * x0;
+   const float x2 = q2 * q3;
+   const float x3 = x1 + 2.0f * x2;
+   const float x4 = 2.0f * ay + 2.0f * x3;
+   const float x5 = q0 * q2;
+   const float x6 = 2.0f * x5;
+   const float x7 = q1 * q3;
+   const float x8 = 2.0f * x7;
+   const float x9 = 2.0f * ax - 2.0f * x6 + 2.0f * x8;
+   const float x10 = q3 * q3;
+   const float x11 = q2 * q2;
+   const float x12 = -x11;
+   const float x13 = q0 * q0;
+   const float x14 = q1 * q1;
+   const float x15 = x13 - x14;
+   const float x16 = mx * (2.0f * q1 * q3 - x6) + my * x3 + mz * (x10 + x12 + x15);
+   const float x17 = x11 - 0.5f;
+   const float x18 = q0 * q3;
+   const float x19 = 2.0f * x18;
+   const float x20 = -x10;
+   const float x21 = mx * (2.0f * q1 * q2 + x19) + my * (x11 + x15 + x20) + mz * (2.0f * q2 * q3 - x1);
+   const float x22 = mx * (x12 + x13 + x14 + x20) + my * (2.0f * q1 * q2 - x19) + mz * (x6 + x8);
+   const float x23 = sqrtf(x21 * x21 + x22 * x22);
+   const float x24 = -mx + x16 * (q1 * q3 - x5) + x23 * (-x10 - x17);
+   const float x25 = q2 * x16;
+   const float x26 = -mz + x16 * (-x14 - x17) + x23 * (x5 + x7);
+   const float x27 = q2 * x23;
+   const float x28 = q1 * x16;
+   const float x29 = q3 * x23;
+   const float x30 = -x29;
+   const float x31 = -my + x16 * (x0 + x2) + x23 * (q1 * q2 - x18);
+   const float x32 = 4.0f * az - 8.0f * x11 - 8.0f * x14 + 4.0f;
+   const float x33 = q3 * x16;
+   const float x34 = q0 * x16;
+   const float x35 = q1 * x23;
+   const float x36 = q0 * x23;
+   s[0] = q1 * x4 - q2 * x9 - x24 * x25 + x26 * x27 + x31 * (x28 + x30);
+   s[1] = q0 * x4 - q1 * x32 + q3 * x9 + x24 * x33 + x26 * (-2.0f * x28 - x30) + x31 * (x27 + x34);
+   s[2] = -q0 * x9 - q2 * x32 + q3 * x4 + x24 * (-2.0f * x27 - x34) + x26 * (-2.0f * x25 + x36) + x31 * (x33 + x35);
+   s[3] = q1 * x9 + q2 * x4 + x24 * (x28 - 2.0f * x29) + x26 * x35 + x31 * (q2 * x16 - x36);
+}
+
+
+#endif /* __MADGWICK_KERNELS_H__ */
+
@@ -0,0 +1,136 @@
+
+/*
+   Fixed-Point Mahony AHRS Implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <stddef.h>
+
+#include "mahony_fixed.h"
+
+
+void mahony_fixed_init(mahony_fixed_t *ahrs, fix_t Kp, fix_t Ki, fix_t gyro_scale)
+{
+   ahrs->twoKp = fix_add(Kp, Kp);
+   ahrs->twoKi = fix_add(Ki, Ki);
+   ahrs->gyro_scale = gyro_scale;
+   ahrs->integral[0] = 0;
+   ahrs->integral[1] = 0;
+   ahrs->integral[2] = 0;
+   ahrs->quat[0] = FIX_ONE;
+   ahrs->quat[1] = 0;
+   ahrs->quat[2] = 0;
+   ahrs->quat[3] = 0;
+}
+
+
+/* normalizes raw sensor values, returns -EDOM for a zero vector: */
+static int normalize_raw(fix_t *out, const int16_t *raw)
+{
+   int64_t in[3] = {raw[0], raw[1], raw[2]};
+   return fix_normalize(out, in, 3);
+}
+
+
+/* accumulates the cross product of the measured and the estimated direction: */
+static void cross_add(int64_t *e, const fix_t *m, const fix_t *v)
+{
+   e[0] += (int64_t)m[1] * v[2] - (int64_t)m[2] * v[1];
+   e[1] += (int64_t)m[2] * v[0] - (int64_t)m[0] * v[2];
+   e[2] += (int64_t)m[0] * v[1] - (int64_t)m[1] * v[0];
+}
+
+
+void mahony_fixed_update(mahony_fixed_t *ahrs, const int16_t *gyro, const int16_t *acc, const int16_t *mag, fix_t dt)
+{
+   fix_t *q = ahrs->quat;
+   int i;
+
+   fix_t g[3];
+   for (i = 0; i < 3; i++)
+   {
+      g[i] = fix_sat((int64_t)gyro[i] * ahrs->gyro_scale);
+   }
+
+   /* compute feedback only if accelerometer measurement valid: */
+   fix_t a[3];
+   if (normalize_raw(a, acc) == 0)
+   {
+      fix_t q0q0 = fix_mul(q[0], q[0]);
+      fix_t q0q1 = fix_mul(q[0], q[1]);
+      fix_t q0q2 = fix_mul(q[0], q[2]);
+      fix_t q0q3 = fix_mul(q[0], q[3]);
+      fix_t q1q1 = fix_mul(q[1], q[1]);
+      fix_t q1q2 = fix_mul(q[1], q[2]);
+      fix_t q1q3 = fix_mul(q[1], q[3]);
+      fix_t q2q2 = fix_mul(q[2], q[2]);
+      fix_t q2q3 = fix_mul(q[2], q[3]);
+      fix_t q3q3 = fix_mul(q[3], q[3]);
+
+      /* estimated direction of gravity: */
+      fix_t halfv[3] = {q1q3 - q0q2, q0q1 + q2q3, q0q0 - FIX(0.5) + q3q3};
+      int64_t halfe[3] = {0, 0, 0};
+      cross_add(halfe, a, halfv);
+
+      /* use IMU algorithm if magnetometer measurement invalid: */
+      fix_t m[3];
+      if (mag != NULL && normalize_raw(m, mag) == 0)
+      {
+         /* reference direction of Earth's magnetic field: */
+         fix_t hx = fix_round(2 * ((int64_t)m[0] * (FIX(0.5) - q2q2 - q3q3) + (int64_t)m[1] * (q1q2 - q0q3) + (int64_t)m[2] * (q1q3 + q0q2)));
+         fix_t hy = fix_round(2 * ((int64_t)m[0] * (q1q2 + q0q3) + (int64_t)m[1] * (FIX(0.5) - q1q1 - q3q3) + (int64_t)m[2] * (q2q3 - q0q1)));
+         fix_t bx = fix_sqrt((int64_t)hx * hx + (int64_t)hy * hy);
+         fix_t bz = fix_round(2 * ((int64_t)m[0] * (q1q3 - q0q2) + (int64_t)m[1] * (q2q3 + q0q1) + (int64_t)m[2] * (FIX(0.5) - q1q1 - q2q2)));
+
+         /* estimated direction of magnetic field: */
+         fix_t halfw[3];
+         halfw[0] = fix_round((int64_t)bx * (FIX(0.5) - q2q2 - q3q3) + (int64_t)bz * (q1q3 - q0q2));
+         halfw[1] = fix_round((int64_t)bx * (q1q2 - q0q3) + (int64_t)bz * (q0q1 + q2q3));
+         halfw[2] = fix_round((int64_t)bx * (q0q2 + q1q3) + (int64_t)bz * (FIX(0.5) - q1q1 - q2q2));
+         cross_add(halfe, m, halfw);
+      }
+
+      for (i = 0; i < 3; i++)
+      {
+         fix_t e = fix_round(halfe[i]);
+         if (ahrs->twoKi > 0)
+         {
+            /* integral error scaled by Ki: */
+            ahrs->integral[i] = fix_add(ahrs->integral[i], fix_mul(fix_mul(ahrs->twoKi, e), dt));
+            g[i] = fix_add(g[i], ahrs->integral[i]);
+         }
+         else
+         {
+            ahrs->integral[i] = 0; /* prevent integral windup */
+         }
+
+         /* apply proportional feedback: */
+         g[i] = fix_add(g[i], fix_mul(ahrs->twoKp, e));
+      }
+   }
+
+   /* integrate rate of change of quaternion and normalize: */
+   for (i = 0; i < 3; i++)
+   {
+      g[i] = fix_mul(g[i], dt / 2);
+   }
+   int64_t qn[4];
+   qn[0] = (int64_t)q[0] * FIX_ONE - (int64_t)q[1] * g[0] - (int64_t)q[2] * g[1] - (int64_t)q[3] * g[2];
+   qn[1] = (int64_t)q[1] * FIX_ONE + (int64_t)q[0] * g[0] + (int64_t)q[2] * g[2] - (int64_t)q[3] * g[1];
+   qn[2] = (int64_t)q[2] * FIX_ONE + (int64_t)q[0] * g[1] - (int64_t)q[1] * g[2] + (int64_t)q[3] * g[0];
+   qn[3] = (int64_t)q[3] * FIX_ONE + (int64_t)q[0] * g[2] + (int64_t)q[1] * g[1] - (int64_t)q[2] * g[0];
+   fix_normalize(q, qn, 4);
+}
+
@@ -0,0 +1,48 @@
+
+/*
+   Fixed-Point Mahony AHRS Interface
+
+   Integer implementation of mahony_ahrs.c for targets without FPU,
+   updated directly from the raw register values of the sensors.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __MAHONY_FIXED_H__
+#define __MAHONY_FIXED_H__
+
+
+#include "fixed.h"
+
+
+typedef struct
+{
+   fix_t twoKp; /* 2 * proportional gain (Kp) */
+   fix_t twoKi; /* 2 * integral gain (Ki) */
+   fix_t gyro_scale; /* rad/s per gyro LSB */
+   fix_t integral[3];
+   fix_t quat[4]; /* quaternion of sensor frame relative to auxiliary frame */
+}
+mahony_fixed_t;
+
+
+void mahony_fixed_init(mahony_fixed_t *ahrs, fix_t Kp, fix_t Ki, fix_t gyro_scale);
+
+/* takes the raw gyro, accelerometer and calibrated magnetometer values,
+   see madgwick_fixed_update */
+void mahony_fixed_update(mahony_fixed_t *ahrs, const int16_t *gyro, const int16_t *acc, const int16_t *mag, fix_t dt);
+
+
+#endif /* __MAHONY_FIXED_H__ */
+
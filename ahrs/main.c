@@ -10,33 +10,35 @@
 int main(void)
 {
    feenableexcept(FE_DIVBYZERO | FE_INVALID | FE_OVERFLOW);
-   memset(&gConfig, 0, sizeof(gConfig));
+   ekf_t ekf;
+   memset(&ekf.config, 0, sizeof(ekf.config));
    
    /* set-up reference vectors: */
-   gConfig.acc_ref.x = 0;
-   gConfig.acc_ref.y = 0;
-   gConfig.acc_ref.z = -1;
+   ekf.config.acc_ref.x = 0;
+   ekf.config.acc_ref.y = 0;
+   ekf.config.acc_ref.z = -1;
    
-   gConfig.mag_ref.x = 1;
-   gConfig.mag_ref.y = 0;
-   gConfig.mag_ref.z = 0;
+   ekf.config.mag_ref.x = 1;
+   ekf.config.mag_ref.y = 0;
+   ekf.config.mag_ref.z = 0;
 
    /* set-up cross-axis alignment: */
-   identity_3x3(&gConfig.gyro_alignment);
-   identity_3x3(&gConfig.acc_alignment);
-   identity_3x3(&gConfig.mag_cal);
+   mat3x3_identity(&ekf.config.gyro_alignment);
+   mat3x3_identity(&ekf.config.acc_alignment);
+   mat3x3_identity(&ekf.config.mag_cal);
 
    /* set-up scales: */
-   gConfig.gyro_scales.x = 1.0;
-   gConfig.gyro_scales.y = 1.0;
-   gConfig.gyro_scales.z = 1.0;
+   ekf.config.gyro_scales.x = 1.0;
+   ekf.config.gyro_scales.y = 1.0;
+   ekf.config.gyro_scales.z = 1.0;
 
    /* set-up covariances: */
-   gConfig.process_covariance = 10.0;
-   gConfig.acc_covariance = 1000.0;
-   gConfig.mag_covariance = 1000.0;
+   ekf.config.process_covariance = 1.0e-4;
+   ekf.config.bias_covariance = 1.0e-8;
+   ekf.config.acc_covariance = 1.0e-3;
+   ekf.config.mag_covariance = 1.0e-3;
 
-   ekf_init();
+   ekf_init(&ekf);
    
    raw_sensor_data_t sensor_data;
    sensor_data.gyro.x = 0.01;
@@ -50,14 +52,22 @@ int main(void)
    sensor_data.mag.x = 1.0;
    sensor_data.mag.y = 0.0;
    sensor_data.mag.z = 0.0;
+   ekf_sensor_init(&ekf, &sensor_data);
 
    int i = 0;
+   uint64_t time = 0;
    while (1) //for (i = 0; i < 10; i++)
    {
+      /* all sensors sampled at 100Hz: */
+      time += 10000000;
+      sensor_data.gyro_time = time;
       sensor_data.new_acc_data = 1;
+      sensor_data.acc_time = time;
       sensor_data.new_mag_data = 1;
-      ekf_run(&sensor_data, 0.01);
-      printf("phi = %f, psi = %f, theta = %f\n", ekf_state.phi, ekf_state.psi, ekf_state.theta);
+      sensor_data.mag_time = time;
+      ekf_run(&ekf, &sensor_data);
+      printf("q = %f %f %f %f, bias = %f %f %f\n", ekf.state.quat.q0, ekf.state.quat.q1, ekf.state.quat.q2, ekf.state.quat.q3,
+             ekf.state.gyro_bias.x, ekf.state.gyro_bias.y, ekf.state.gyro_bias.z);
    }
    return 0;
 }
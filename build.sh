@@ -1,3 +1,8 @@
 #!/bin/sh
 
-gcc -std=gnu99 kalman.c util/sliding_avg.c util/math.c util/interval.c util/udp4.c mpu_main.c ahrs/madgwick_ahrs.c ahrs/ekf.c ahrs/matrix3x3.c i2c/i2c.c ahrs/util.c chips/itg3200/itg3200.c chips/bma180/bma180.c chips/mpu6050/mpu6050.c chips/hmc5883/hmc5883.c chips/ms5611/ms5611.c ahrs/mahony_ahrs.c -lm -lrt -lmeschach -o pengu_ahrs
+# regenerate the filter kernels from their symbolic models if sympy is installed:
+if python3 -c "import sympy" 2>/dev/null; then
+   python3 ahrs/gen_kernels.py || exit 1
+fi
+
+gcc -std=gnu99 kalman.c util/sliding_avg.c util/math.c util/interval.c util/drdy.c util/mag_cal.c util/udp4.c mpu_main.c ahrs/madgwick_ahrs.c ahrs/gyro_bias.c ahrs/ekf.c ahrs/ekf_batch.c i2c/i2c.c i2c/i2c_sim.c i2c/i2c_worker.c i2c/i2c_stats.c i2c/i2c_trace.c i2c/i2c_replay.c ahrs/util.c chips/itg3200/itg3200.c chips/bma180/bma180.c chips/mpu6050/mpu6050.c chips/hmc5883/hmc5883.c chips/ms5611/ms5611.c chips/sensor.c chips/sensor_drivers.c ahrs/mahony_ahrs.c ahrs/ahrs_batch.c ahrs/fixed.c ahrs/madgwick_fixed.c ahrs/mahony_fixed.c -lm -lrt -lpthread -o pengu_ahrs
@@ -279,23 +279,25 @@ int bma180_read_temp(bma180_dev_t *dev)
 }
 
 
-int bma180_read_acc(bma180_dev_t *dev)
+int bma180_queue_acc(bma180_dev_t *dev, i2c_batch_t *batch)
 {
-   float range = ACC_RANGE_TABLE[dev->range];
-   /* read acc values */
-   uint8_t acc_data[6];
-   int ret = i2c_read_block_reg(&dev->i2c_dev, BMA180_ACC_X_LSB, acc_data, sizeof(acc_data));
-   if (ret < 0)
-   {
-      memset(&dev->raw.vec, 0, sizeof(dev->raw.vec));
-      goto out;
-   }
+   return i2c_batch_add_read(batch, &dev->i2c_dev, BMA180_ACC_X_LSB, dev->acc_buf, sizeof(dev->acc_buf));
+}
 
+
+int bma180_parse_acc(bma180_dev_t *dev)
+{
+   float range = ACC_RANGE_TABLE[dev->range];
+   uint8_t *acc_data = dev->acc_buf;
+   int new_data = 0;
    int i;
    for (i = 0; i < 3; i++)
    {
+      /* new_data flag, cleared by reading the register: */
+      new_data |= acc_data[(i << 1)] & 0x01;
       /* put them together */
       int16_t raw = (int16_t)((acc_data[(i << 1) + 1] << 8) | (acc_data[(i << 1)] & 0xFC)) / 4;
+      dev->adc[i] = raw;
       /* and scale according to range setting */
       float fraw = (float)(raw) * range / (float)(1 << 13);
       if (fraw > range)
@@ -310,9 +312,20 @@ int bma180_read_acc(bma180_dev_t *dev)
       dev->raw.vec[i] = fraw;
       dev->acc.vec[i] = dev->raw.vec[i] - dev->avg.vec[i];
    }
+   return new_data;
+}
 
-out:
-   return ret;
+
+int bma180_read_acc(bma180_dev_t *dev)
+{
+   /* read acc values */
+   int ret = i2c_read_block_reg(&dev->i2c_dev, BMA180_ACC_X_LSB, dev->acc_buf, sizeof(dev->acc_buf));
+   if (ret < 0)
+   {
+      memset(&dev->raw.vec, 0, sizeof(dev->raw.vec));
+      return ret;
+   }
+   return bma180_parse_acc(dev);
 }
 
 
@@ -338,6 +351,7 @@ int bma180_avg_acc(bma180_dev_t *dev)
    {
       dev->avg.vec[i] /= 200.0;
    }
+   ret = 0; /* stale samples are averaged as well */
 
 out:
    return ret;
@@ -106,7 +106,11 @@ typedef struct
    } 
    gain;
 
+   /* acc register data, filled by batched reads: */
+   uint8_t acc_buf[6];
+
    /* raw reading: */
+   int16_t adc[3]; /* register values, e.g. for fixed-point filters */
    vec3_t raw;
 
    /* calibration data: */
@@ -120,8 +124,16 @@ bma180_dev_t;
 
 int bma180_init(bma180_dev_t *dev, i2c_bus_t *bus, bma180_range_t range, bma180_bw_t bandwidth);
 
+/* returns 1 if any axis has new data since the last read, 0 if the data is stale
+   or a negative error code */
 int bma180_read_acc(bma180_dev_t *dev);
 
+/* adds the acc registers to a batch, call bma180_parse_acc after running it: */
+int bma180_queue_acc(bma180_dev_t *dev, i2c_batch_t *batch);
+
+/* returns 1 if any axis has new data since the last read, 0 if the data is stale */
+int bma180_parse_acc(bma180_dev_t *dev);
+
 int bma180_read_temp(bma180_dev_t *dev);
 
 int bma180_avg_acc(bma180_dev_t *dev);
@@ -97,43 +97,11 @@ static int hmc5883_std_config(hmc5883_dev_t *dev)
 }
 
 
-static int hmc5883_cal(hmc5883_dev_t *dev)
-{
-   int ret = hmc5883_std_config(dev);
-   
-   float raw_min[3];
-   float raw_max[3];
-   int i;
-   for (i = 0; i < 1000; i++)
-   {
-      int ret = hmc5883_read(dev);
-      if (ret < 0)
-      {
-         return ret;
-      }
-      int j;
-      for (j = 0; j < 3; j++)
-      {
-         raw_min[j] = raw_min[j] < dev->raw.vec[j] ? raw_min[j] : dev->raw.vec[j];
-         raw_max[j] = raw_max[j] > dev->raw.vec[j] ? raw_max[j] : dev->raw.vec[j];
-         dev->scale.vec[j] = 2.0 / (raw_max[i] - raw_min[i]);
-         dev->shift.vec[j] = 1.0 - raw_max[i] * dev->scale.vec[i];
-      }
-   }
-}
-
-
 int hmc5883_init(hmc5883_dev_t *dev, i2c_bus_t *bus)
 {
    int ret = 0;
-   
-   int i;
-   for (i = 0; i < 3; i++)
-   {
-      dev->scale.vec[i] = 1.0;
-      dev->shift.vec[i] = 0.0;
-   }
-   
+   mag_cal_pub_init(&dev->cal);
+   memset(dev->last, 0, sizeof(dev->last));
    i2c_dev_init(&dev->i2c_dev, bus, HMC5883_ADDRESS);
 
    uint8_t id[3];
@@ -149,34 +117,51 @@ int hmc5883_init(hmc5883_dev_t *dev, i2c_bus_t *bus)
    }
 
    ret = hmc5883_std_config(dev);
-   if (ret < 0)
-   {
-      goto out;
-   }
-   //ret = hmc5883_cal(dev);
 
 out:
    return ret;
 }
 
 
-int hmc5883_read(hmc5883_dev_t *dev)
+int hmc5883_queue(hmc5883_dev_t *dev, i2c_batch_t *batch)
 {
-   uint8_t data[6];
-   int ret = i2c_read_block_reg(&dev->i2c_dev, HMC5883_MAGX_H, data, sizeof(data));
-   dev->raw.x = (int16_t)((data[0] << 8) | data[1]);
-   dev->raw.z = (int16_t)((data[2] << 8) | data[3]);
-   dev->raw.y = (int16_t)((data[4] << 8) | data[5]);
+   return i2c_batch_add_read(batch, &dev->i2c_dev, HMC5883_MAGX_H, dev->buf, sizeof(dev->buf));
+}
 
-   dev->shift.vec[0] = -61.5;
-   dev->shift.vec[1] = 66.0;
-   dev->shift.vec[2] = 381.5;
 
+int hmc5883_parse(hmc5883_dev_t *dev)
+{
+   uint8_t *data = dev->buf;
+   dev->adc[0] = (int16_t)((data[0] << 8) | data[1]);
+   dev->adc[2] = (int16_t)((data[2] << 8) | data[3]);
+   dev->adc[1] = (int16_t)((data[4] << 8) | data[5]);
    int i;
    for (i = 0; i < 3; i++)
    {
-      dev->mag.vec[i] = dev->scale.vec[i] * dev->raw.vec[i] + dev->shift.vec[i];
+      dev->raw.vec[i] = dev->adc[i];
+   }
+
+   mag_cal_params_t cal;
+   mag_cal_get(&dev->cal, &cal);
+   mag_cal_apply(&cal, &dev->mag, &dev->raw);
+
+   /* the RDY status bit is not cleared by reading, only while the chip writes the next result,
+      so new data is detected by comparing with the previous read;
+      a new sample repeating all three values is dropped as well: */
+   int fresh = memcmp(data, dev->last, sizeof(dev->last)) != 0;
+   memcpy(dev->last, data, sizeof(dev->last));
+   return fresh;
+}
+
+
+int hmc5883_read(hmc5883_dev_t *dev)
+{
+   int ret = i2c_read_block_reg(&dev->i2c_dev, HMC5883_MAGX_H, dev->buf, sizeof(dev->buf));
+   if (ret < 0)
+   {
+      return ret;
    }
+   return hmc5883_parse(dev);
 }
 
 
@@ -201,6 +186,7 @@ int hmc5883_avg_mag(hmc5883_dev_t *dev)
    {
       dev->avg.vec[i] /= 200.0;
    }
+   ret = 0; /* stale samples are averaged as well */
 
 out:
    return ret;
@@ -24,6 +24,15 @@
 
 #include "../../i2c/i2c.h"
 #include "../../util/math.h"
+#include "../../util/mag_cal.h"
+
+
+/* data registers (x, z, y; big endian) followed by the status register,
+   e.g. for reads by an auxiliary bus master: */
+#define HMC5883_DATA_REG 0x03
+
+/* output data period of the standard configuration (50Hz) in ns: */
+#define HMC5883_PERIOD 20000000
 
 
 typedef struct
@@ -31,12 +40,18 @@ typedef struct
    /* i2c device: */
    i2c_dev_t i2c_dev;
 
+   /* data register contents, filled by batched reads: */
+   uint8_t buf[6];
+
+   /* data registers of the previous read, to detect repeated samples: */
+   uint8_t last[6];
+
    /* raw measurements: */
+   int16_t adc[3]; /* register values in x, y, z order, e.g. for fixed-point filters */
    vec3_t raw;
 
-   /* calibration data: */
-   vec3_t scale;
-   vec3_t shift;
+   /* calibration data, published by an online calibration: */
+   mag_cal_pub_t cal;
    vec3_t avg;
 
    /* processed measurements: */
@@ -47,8 +62,16 @@ hmc5883_dev_t;
 
 int hmc5883_init(hmc5883_dev_t *dev, i2c_bus_t *bus);
 
+/* returns 1 if the data is new, 0 if it has been read before
+   or a negative error code */
 int hmc5883_read(hmc5883_dev_t *dev);
 
+/* adds the data and status registers to a batch, call hmc5883_parse after running it: */
+int hmc5883_queue(hmc5883_dev_t *dev, i2c_batch_t *batch);
+
+/* returns 1 if the data is new, 0 if it has been read before */
+int hmc5883_parse(hmc5883_dev_t *dev);
+
 int hmc5883_avg_mag(hmc5883_dev_t *dev);
 
 
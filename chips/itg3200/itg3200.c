@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 
@@ -69,24 +70,33 @@
 
 
 
-static int read_gyro_raw(itg3200_dev_t *dev, int16_t *data)
+static void gyro_raw_decode(int16_t *data, const uint8_t *raw)
 {
-   uint8_t raw[6];
+   int i;
+   for(i = 0; i < 3; i++)
+   {
+      data[i] = (int16_t)((raw[(i << 1)] << 8) | raw[(i << 1) + 1]);
+   }
+}
+
 
+static int read_gyro_raw(itg3200_dev_t *dev, int16_t *data)
+{
    /* read gyro registers */
+   uint8_t raw[6];
    int ret = i2c_read_block_reg(&dev->i2c_dev, ITG3200_GYRO_XOUT_H, raw, sizeof(raw));
    if (ret < 0)
    {
       return ret;
    }
+   gyro_raw_decode(data, raw);
+   return 0;
+}
 
-   int i;
-   for(i = 0; i < 3; i++)
-   {
-      data[i] = (int16_t)((raw[(i << 1)] << 8) | raw[(i << 1) + 1]);
-   }
 
-   return 0;
+static float temp_decode(const uint8_t *raw)
+{
+   return (3500.0 + (float)((int16_t)(raw[0] << 8 | raw[1]) + 13200) / 2.80) / 100.0;
 }
 
 
@@ -130,6 +140,7 @@ int itg3200_init(itg3200_dev_t *dev, i2c_bus_t *bus, itg3200_dlpf_t filter)
    /* copy values */
    i2c_dev_init(&dev->i2c_dev, bus, ITG3200_ADDRESS);
    dev->lp_filter = filter;
+   memset(dev->bias, 0, sizeof(dev->bias)); /* see itg3200_zero_gyros */
 
    /* reset */
    int ret = i2c_write_reg(&dev->i2c_dev, ITG3200_PWR_MGM, ITG3200_PWR_MGM_H_RESET);
@@ -169,39 +180,51 @@ int itg3200_init(itg3200_dev_t *dev, i2c_bus_t *bus, itg3200_dlpf_t filter)
 
    /* set full scale mode and low-pass filter */
    ret = i2c_write_reg(&dev->i2c_dev, ITG3200_DLPF_FS, ITG3200_DLPF_FS_FS_SEL(0x3) | ITG3200_DLPF_FS_DLPF_CFG(dev->lp_filter));
-   if (ret < 0)
-   {
-      goto out;
-   }
-
-#ifdef ITG3200_DEBUG
-   printf("ITG3200, calibrating\n");
-#endif
-   
-   /* calibrate: */
-   ret = itg3200_zero_gyros(dev);
 
 out:
    return ret;
 }
 
 
-int itg3200_read_gyro(itg3200_dev_t *dev)
+int itg3200_queue_gyro(itg3200_dev_t *dev, i2c_batch_t *batch)
 {
-   int16_t val[3];
-   int ret = read_gyro_raw(dev, val);
-   if (ret < 0)
-   {
-      return ret;
-   }
+   /* the status register precedes temperature and gyro data, so one block covers all: */
+   return i2c_batch_add_read(batch, &dev->i2c_dev, ITG3200_INT_STATUS, dev->buf, sizeof(dev->buf));
+}
+
+
+int itg3200_parse_gyro(itg3200_dev_t *dev)
+{
+   dev->temperature = temp_decode(&dev->buf[ITG3200_TEMP_OUT_H - ITG3200_INT_STATUS]);
+   gyro_raw_decode(dev->adc, &dev->buf[ITG3200_GYRO_XOUT_H - ITG3200_INT_STATUS]);
 
    /* construct, scale and bias-correct values: */
    int i;
    for (i = 0; i < 3; i++)
    {
-      dev->gyro.data[i] = ((float)(val[i] + dev->bias[i]) / 14.375) * M_PI / 180.0;
+      dev->gyro.data[i] = ((float)(dev->adc[i] + dev->bias[i]) / 14.375) * M_PI / 180.0;
    }
-   return 0;
+
+   /* reading the status register clears the ready flag: */
+   return (dev->buf[0] & ITG3200_INT_STATUS_RAW_DATA_RDY) != 0;
+}
+
+
+int itg3200_read_gyro(itg3200_dev_t *dev)
+{
+   int ret = i2c_read_block_reg(&dev->i2c_dev, ITG3200_INT_STATUS, dev->buf, sizeof(dev->buf));
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return itg3200_parse_gyro(dev);
+}
+
+
+int itg3200_int_enable(itg3200_dev_t *dev)
+{
+   /* active high, push-pull, 50us pulse per sample: */
+   return i2c_write_reg(&dev->i2c_dev, ITG3200_INT_CFG, ITG3200_INT_CFG_RAW_RDY_EN | ITG3200_INT_CFG_INT_ANYRD_RDY_2CLEAR);
 }
 
 
@@ -217,7 +240,7 @@ int itg3200_read_temp(itg3200_dev_t *dev)
    }
 
    /* construct and scale value: */
-   dev->temperature = (3500.0 + (float)((int16_t)(raw[0] << 8 | raw[1]) + 13200) / 2.80) / 100.0;
+   dev->temperature = temp_decode(raw);
    return 0;
 }
 
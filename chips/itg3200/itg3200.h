@@ -50,7 +50,11 @@ typedef struct
    /* calibration settings: */
    float bias[3];
 
+   /* INT_STATUS, temperature and gyro register data, filled by batched reads: */
+   uint8_t buf[9];
+
    /* measurements: */
+   int16_t adc[3]; /* register values, e.g. for fixed-point filters */
    float temperature;
    union 
    {
@@ -69,12 +73,26 @@ itg3200_dev_t;
 
 int itg3200_init(itg3200_dev_t *dev, i2c_bus_t *bus, itg3200_dlpf_t filter);
 
+/* blocking bias calibration, the gyro must rest: returns -EAGAIN if it moved;
+   for calibration during operation, see ahrs/gyro_bias.h */
 int itg3200_zero_gyros(itg3200_dev_t *dev);
 
+/* returns 1 if the gyro has sampled since the last read, 0 if the data is stale
+   or a negative error code */
 int itg3200_read_gyro(itg3200_dev_t *dev);
 
+/* adds the status, temperature and gyro registers to a batch,
+   call itg3200_parse_gyro after running it: */
+int itg3200_queue_gyro(itg3200_dev_t *dev, i2c_batch_t *batch);
+
+/* returns 1 if the gyro has sampled since the last read, 0 if the data is stale */
+int itg3200_parse_gyro(itg3200_dev_t *dev);
+
 int itg3200_read_temp(itg3200_dev_t *dev);
 
+/* enables the raw data ready interrupt: */
+int itg3200_int_enable(itg3200_dev_t *dev);
+
 
 #endif /* __ITG3200_H__ */
 
@@ -4,8 +4,11 @@
 #include <math.h>
 #include <time.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "mpu6050.h"
+#include "../../util/interval.h"
 
 
 #define MPU6050_ADDRESS						0x69
@@ -30,8 +33,15 @@
 #define MPU6050_MOT_THR						0x1F
 
 #define MPU6050_FIFO_EN						0x23
+#define MPU6050_FIFO_EN_ACCEL				(1 << 3)
+#define MPU6050_FIFO_EN_ZG					(1 << 4)
+#define MPU6050_FIFO_EN_YG					(1 << 5)
+#define MPU6050_FIFO_EN_XG					(1 << 6)
+#define MPU6050_FIFO_EN_TEMP				(1 << 7)
 
 #define MPU6050_I2C_MST_CTRL				0x24
+#define MPU6050_I2C_MST_CTRL_CLK_400KHZ		13
+#define MPU6050_I2C_MST_CTRL_WAIT_FOR_ES	(1 << 6)
 #define MPU6050_I2C_SLV0_ADDR				0x25
 #define MPU6050_I2C_SLV0_REG				0x26
 #define MPU6050_I2C_SLV0_CTRL				0x27
@@ -48,12 +58,25 @@
 #define MPU6050_I2C_SLV4_REG				0x32
 #define MPU6050_I2C_SLV4_DO					0x33
 #define MPU6050_I2C_SLV4_CTRL				0x34
+#define MPU6050_I2C_SLV4_CTRL_MST_DLY(x)	((x) & 0x1F)
 #define MPU6050_I2C_SLV4_DI					0x35
 #define MPU6050_I2C_MST_STATUS				0x36
 
+#define MPU6050_I2C_SLV_ADDR_RW				(1 << 7)
+#define MPU6050_I2C_SLV_CTRL_EN				(1 << 7)
+#define MPU6050_I2C_SLV_CTRL_LEN(x)			((x) & 0xF)
+
 #define MPU6050_INT_PIN_CFG					0x37
+#define MPU6050_INT_PIN_CFG_I2C_BYPASS_EN	(1 << 1)
+#define MPU6050_INT_PIN_CFG_INT_RD_CLEAR	(1 << 4)
+#define MPU6050_INT_PIN_CFG_LATCH_INT_EN	(1 << 5)
+#define MPU6050_INT_PIN_CFG_INT_OPEN		(1 << 6)
+#define MPU6050_INT_PIN_CFG_INT_LEVEL		(1 << 7)
+
 #define MPU6050_INT_ENABLE					0x38
+#define MPU6050_INT_ENABLE_DATA_RDY_EN		(1 << 0)
 #define MPU6050_INT_STATUS					0x3A
+#define MPU6050_INT_STATUS_DATA_RDY			(1 << 0)
 
 #define MPU6050_ACCEL_XOUT_H				0x3B
 #define MPU6050_ACCEL_XOUT_L				0x3C
@@ -108,6 +131,9 @@
 #define MPU6050_MOT_DETECT_CTRL				0x69
 
 #define MPU6050_USER_CTRL					0x6A
+#define MPU6050_USER_CTRL_FIFO_RESET		(1 << 2)
+#define MPU6050_USER_CTRL_I2C_MST_EN		(1 << 5)
+#define MPU6050_USER_CTRL_FIFO_EN			(1 << 6)
 
 #define MPU6050_PWR_MGMT_1					0x6B
 #define MPU6050_PWR_MGMT_1_CLKSEL(x)		((x) & 0x7)
@@ -140,6 +166,12 @@ int mpu6050_init(mpu6050_dev_t *dev, i2c_bus_t *bus, mpu6050_dlpf_cfg_t dlpf, mp
 	dev->dlpf = dlpf;
 	dev->gfs = fs_sel;
 	dev->afs = afs_sel;
+	dev->fifo_period = 0;
+	dev->fifo_time = 0;
+	dev->aux_n = 0;
+	dev->ext_len = 0;
+	dev->user_ctrl = 0;
+	dev->int_pin_cfg = 0;
 
 	i2c_dev_init(&dev->i2c_dev, bus, MPU6050_ADDRESS);
 
@@ -149,9 +181,9 @@ int mpu6050_init(mpu6050_dev_t *dev, i2c_bus_t *bus, mpu6050_dlpf_cfg_t dlpf, mp
 		goto out;
 	}
 	
-	/* validate address: */
+	/* validate address, AD0 is not reflected in WHO_AM_I: */
 	uint8_t addr = (uint8_t)(ret);
-	if (dev->i2c_dev.addr != addr)
+	if ((dev->i2c_dev.addr & 0x7E) != (addr & 0x7E))
 	{
 		ret = -ENODEV;
 		goto out;
@@ -196,51 +228,289 @@ out:
 	return ret;
 }
 
-static int read_raw(mpu6050_dev_t *dev, int16_t *data)
+static void scale_acc(mpu6050_dev_t *dev, vec3_t *acc, int16_t *val)
 {
-	int ret, i;
-	uint8_t raw[14];	/* 6 bytes ACC, 2 temperature, 6 gyro */
+	int i;
+	for(i = 0; i < 3; i++)
+	{
+		acc->vec[i] = (float)(val[i]) / (float)((1 << 14) >> dev->afs);
+	}
+}
 
-	ret = i2c_read_block_reg(&dev->i2c_dev, MPU6050_ACCEL_XOUT_H, raw, sizeof(raw));
+static void scale_gyro(mpu6050_dev_t *dev, vec3_t *gyro, int16_t *val)
+{
+	int i;
+	for(i = 0; i < 3; i++)
+	{
+		gyro->vec[i] = (float)(val[i]) * (float)(250 << dev->gfs) / (float)(1 << 15);
+	}
+}
+
+/* converts a block read starting at ACCEL_XOUT_H: 6 bytes ACC, 2 temperature, 6 gyro, external sensor data */
+static void decode(mpu6050_dev_t *dev, const uint8_t *raw)
+{
+	size_t i;
+	int16_t val[7];
+
+	for(i = 0; i < 7; i++)
+	{
+		val[i] = (int16_t)((raw[(i << 1)] << 8) | raw[(i << 1) + 1]);
+	}
+
+	/* distribute external sensor data, in slave order */
+	const uint8_t *ext = &raw[14];
+	for(i = 0; i < dev->aux_n; i++)
+	{
+		memcpy(dev->aux[i].buf, ext, dev->aux[i].len);
+		ext += dev->aux[i].len;
+	}
+
+	scale_acc(dev, &dev->acc, &val[0]);
+	dev->temperature = (float)(val[3]) / 340.0 + 36.53;
+	scale_gyro(dev, &dev->gyro, &val[4]);
+}
+
+int mpu6050_read(mpu6050_dev_t *dev)
+{
+	uint8_t raw[14 + MPU6050_EXT_SENS_SIZE];
+
+	int ret = i2c_read_block_reg(&dev->i2c_dev, MPU6050_ACCEL_XOUT_H, raw, 14 + dev->ext_len);
 	if(ret < 0)
+	{
+		return ret;
+	}
+	decode(dev, raw);
+	return 0;
+}
+
+int mpu6050_queue(mpu6050_dev_t *dev, i2c_batch_t *batch)
+{
+	/* the interrupt status register precedes the data registers, so one block covers both */
+	return i2c_batch_add_read(batch, &dev->i2c_dev, MPU6050_INT_STATUS, dev->buf, 1 + 14 + dev->ext_len);
+}
+
+int mpu6050_parse(mpu6050_dev_t *dev)
+{
+	decode(dev, &dev->buf[1]);
+
+	/* reading the status register clears the data-ready flag */
+	return (dev->buf[0] & MPU6050_INT_STATUS_DATA_RDY) != 0;
+}
+
+static int fifo_reset(mpu6050_dev_t *dev)
+{
+	dev->fifo_time = 0;
+	dev->user_ctrl |= MPU6050_USER_CTRL_FIFO_EN;
+	return i2c_write_reg(&dev->i2c_dev, MPU6050_USER_CTRL, dev->user_ctrl | MPU6050_USER_CTRL_FIFO_RESET);
+}
+
+int mpu6050_fifo_enable(mpu6050_dev_t *dev, uint8_t smplrt_div)
+{
+	int ret;
+
+	/* configure output rate */
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_SMPLRT_DIV, smplrt_div);
+	if (ret < 0)
 	{
 		goto out;
 	}
+	uint64_t base = dev->dlpf == MPU6050_DLPF_CFG_260_256Hz ? 125000 : 1000000;
+	dev->fifo_period = base * (1 + smplrt_div);
 
-	for(i = 0; i < (sizeof(raw) >> 1); i++)
+	/* push accelerometer and gyroscope samples (12 bytes) */
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_FIFO_EN, MPU6050_FIFO_EN_ACCEL | MPU6050_FIFO_EN_XG | MPU6050_FIFO_EN_YG | MPU6050_FIFO_EN_ZG);
+	if (ret < 0)
 	{
-		data[i] = (int16_t)((raw[(i << 1)] << 8) | raw[(i << 1) + 1]);
+		goto out;
 	}
 
+	ret = fifo_reset(dev);
+
 out:
 	return ret;
 }
 
-int mpu6050_read(mpu6050_dev_t *dev)
+int mpu6050_fifo_read(mpu6050_dev_t *dev, mpu6050_sample_t *samples, size_t max)
 {
-	int i, off, ret;
-	int16_t val[7];
+	int ret;
+	size_t i, j;
+	uint8_t raw[2];
+	int64_t period = dev->fifo_period;
 
-	ret = read_raw(dev, val);
-	if(ret < 0)
+	ret = i2c_read_block_reg(&dev->i2c_dev, MPU6050_FIFO_COUNTH, raw, sizeof(raw));
+	if (ret < 0)
 	{
 		goto out;
 	}
+	uint64_t now = monotonic_raw_ns();
+	size_t count = (raw[0] << 8) | raw[1];
 
-	for(i = 0; i < 3; i++)
+	/* the FIFO does not hold a whole number of samples, so a full FIFO has overflown */
+	if (count > (MPU6050_FIFO_SIZE / MPU6050_FIFO_SAMPLE_SIZE) * MPU6050_FIFO_SAMPLE_SIZE)
 	{
-		dev->acc.vec[i] = (float)(val[i]) / (float)((1 << 14) >> dev->afs);
+		ret = fifo_reset(dev);
+		if (ret == 0)
+		{
+			ret = -EOVERFLOW;
+		}
+		goto out;
 	}
-	
-	dev->temperature = (float)(val[i++]) / 340.0 + 36.53;
-	off = i;
-	
-	for(; i < 7; i++)
+	size_t avail = count / MPU6050_FIFO_SAMPLE_SIZE;
+	if (avail == 0)
 	{
-		dev->gyro.vec[i - off] = (float)(val[i]) * (float)(250 << dev->gfs) / (float)(1 << 15);
+		goto out;
 	}
-	
+
+	/* the newest sample was taken within the last period;
+	   follow the drift of the chip's oscillator slowly, resync after gaps */
+	uint64_t newest = now - period / 2;
+	int64_t err = (int64_t)(newest - (dev->fifo_time + avail * period));
+	if (dev->fifo_time == 0 || llabs(err) > 2 * period)
+	{
+		dev->fifo_time = newest - avail * period;
+	}
+	else
+	{
+		dev->fifo_time += err / 16;
+	}
+
+	size_t n = avail < max ? avail : max;
+	ret = i2c_read_block_reg(&dev->i2c_dev, MPU6050_FIFO_R_W, dev->fifo_buf, n * MPU6050_FIFO_SAMPLE_SIZE);
+	if (ret < 0)
+	{
+		dev->fifo_time = 0;
+		goto out;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		int16_t val[6];
+		uint8_t *p = &dev->fifo_buf[i * MPU6050_FIFO_SAMPLE_SIZE];
+		for (j = 0; j < 6; j++)
+		{
+			val[j] = (int16_t)((p[j << 1] << 8) | p[(j << 1) + 1]);
+		}
+		dev->fifo_time += period;
+		samples[i].time = dev->fifo_time;
+		scale_acc(dev, &samples[i].acc, &val[0]);
+		scale_gyro(dev, &samples[i].gyro, &val[3]);
+	}
+	ret = n;
+
 out:
 	return ret;
 }
 
+
+int mpu6050_int_enable(mpu6050_dev_t *dev)
+{
+	int ret;
+
+	/* active high, push-pull, 50us pulse per sample */
+	dev->int_pin_cfg |= MPU6050_INT_PIN_CFG_INT_RD_CLEAR;
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_INT_PIN_CFG, dev->int_pin_cfg);
+	if (ret < 0)
+	{
+		goto out;
+	}
+
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_INT_ENABLE, MPU6050_INT_ENABLE_DATA_RDY_EN);
+
+out:
+	return ret;
+}
+
+int mpu6050_aux_bypass(mpu6050_dev_t *dev, int enable)
+{
+	int ret;
+
+	if (enable)
+	{
+		/* bypass and master mode are exclusive */
+		dev->user_ctrl &= ~MPU6050_USER_CTRL_I2C_MST_EN;
+		ret = i2c_write_reg(&dev->i2c_dev, MPU6050_USER_CTRL, dev->user_ctrl);
+		if (ret < 0)
+		{
+			goto out;
+		}
+		dev->int_pin_cfg |= MPU6050_INT_PIN_CFG_I2C_BYPASS_EN;
+	}
+	else
+	{
+		dev->int_pin_cfg &= ~MPU6050_INT_PIN_CFG_I2C_BYPASS_EN;
+	}
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_INT_PIN_CFG, dev->int_pin_cfg);
+
+out:
+	return ret;
+}
+
+int mpu6050_aux_add_read(mpu6050_dev_t *dev, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len, uint8_t delay)
+{
+	int ret;
+	uint8_t slv = dev->aux_n;
+
+	if (slv == MPU6050_AUX_SLAVES || len > 15 || dev->ext_len + len > MPU6050_EXT_SENS_SIZE)
+	{
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	/* 400kHz master clock, data ready is delayed until external data is loaded */
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_I2C_MST_CTRL, MPU6050_I2C_MST_CTRL_WAIT_FOR_ES | MPU6050_I2C_MST_CTRL_CLK_400KHZ);
+	if (ret < 0)
+	{
+		goto out;
+	}
+
+	/* slave registers are laid out in groups of 3 (ADDR, REG, CTRL) */
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_I2C_SLV0_ADDR + 3 * slv, MPU6050_I2C_SLV_ADDR_RW | addr);
+	if (ret < 0)
+	{
+		goto out;
+	}
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_I2C_SLV0_REG + 3 * slv, reg);
+	if (ret < 0)
+	{
+		goto out;
+	}
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_I2C_SLV0_CTRL + 3 * slv, MPU6050_I2C_SLV_CTRL_EN | MPU6050_I2C_SLV_CTRL_LEN(len));
+	if (ret < 0)
+	{
+		goto out;
+	}
+
+	/* reduced access rate, enabled for all slaves */
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_I2C_SLV4_CTRL, MPU6050_I2C_SLV4_CTRL_MST_DLY(delay));
+	if (ret < 0)
+	{
+		goto out;
+	}
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_I2C_MST_DELAY_CT, (1 << (slv + 1)) - 1);
+	if (ret < 0)
+	{
+		goto out;
+	}
+
+	/* enable master mode */
+	dev->int_pin_cfg &= ~MPU6050_INT_PIN_CFG_I2C_BYPASS_EN;
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_INT_PIN_CFG, dev->int_pin_cfg);
+	if (ret < 0)
+	{
+		goto out;
+	}
+	dev->user_ctrl |= MPU6050_USER_CTRL_I2C_MST_EN;
+	ret = i2c_write_reg(&dev->i2c_dev, MPU6050_USER_CTRL, dev->user_ctrl);
+	if (ret < 0)
+	{
+		goto out;
+	}
+
+	dev->aux[slv].buf = buf;
+	dev->aux[slv].len = len;
+	dev->aux_n++;
+	dev->ext_len += len;
+
+out:
+	return ret;
+}
@@ -51,6 +51,23 @@ typedef enum
 }
 mpu6050_afs_sel_t;
 
+/* FIFO capacity and size of a sample (accelerometer and gyroscope) in bytes */
+#define MPU6050_FIFO_SIZE			1024
+#define MPU6050_FIFO_SAMPLE_SIZE	12
+
+/* FIFO sample with its reconstructed time */
+typedef struct
+{
+	uint64_t time;	/* CLOCK_MONOTONIC_RAW in ns, see monotonic_raw_ns() */
+	vec3_t gyro;
+	vec3_t acc;
+}
+mpu6050_sample_t;
+
+/* auxiliary bus slaves read by the MPU6050 (SLV0..3, 24 bytes of EXT_SENS_DATA) */
+#define MPU6050_AUX_SLAVES			4
+#define MPU6050_EXT_SENS_SIZE		24
+
 typedef struct
 {
 	i2c_dev_t i2c_dev;
@@ -61,8 +78,30 @@ typedef struct
 
 	float temperature;
 
+	/* interrupt status and data registers, filled by batched reads */
+	uint8_t buf[1 + 14 + MPU6050_EXT_SENS_SIZE];
+
 	vec3_t gyro;
 	vec3_t acc;
+
+	/* FIFO mode state */
+	uint64_t fifo_period;	/* sample period in ns, 0 if disabled */
+	uint64_t fifo_time;		/* time of the last sample read, 0 if unknown */
+	uint8_t fifo_buf[MPU6050_FIFO_SIZE];
+
+	/* auxiliary bus master state */
+	struct
+	{
+		uint8_t *buf;
+		size_t len;
+	}
+	aux[MPU6050_AUX_SLAVES];
+	size_t aux_n;
+	size_t ext_len;		/* EXT_SENS_DATA bytes in use */
+
+	/* shadows of shared configuration registers */
+	uint8_t user_ctrl;
+	uint8_t int_pin_cfg;
 }
 mpu6050_dev_t;
 
@@ -71,5 +110,33 @@ int mpu6050_init(mpu6050_dev_t *dev, i2c_bus_t *bus, mpu6050_dlpf_cfg_t dlpf, mp
 
 int mpu6050_read(mpu6050_dev_t *dev);
 
+/* Adds the status and data registers to a batch, call mpu6050_parse after running it */
+int mpu6050_queue(mpu6050_dev_t *dev, i2c_batch_t *batch);
+
+/* Returns 1 if the data is new, 0 if it has been read before */
+int mpu6050_parse(mpu6050_dev_t *dev);
+
+/* Enables the FIFO for accelerometer and gyroscope data.
+   The output rate is 8kHz (DLPF off) or 1kHz (DLPF on) / (1 + smplrt_div). */
+int mpu6050_fifo_enable(mpu6050_dev_t *dev, uint8_t smplrt_div);
+
+/* Drains up to max samples from the FIFO in one burst and timestamps them
+   based on the output rate. Returns the number of samples or a negative error;
+   after an overflow the FIFO is reset and -EOVERFLOW is returned. */
+int mpu6050_fifo_read(mpu6050_dev_t *dev, mpu6050_sample_t *samples, size_t max);
+
+/* Enables the data-ready interrupt: an active high pulse on INT per sample */
+int mpu6050_int_enable(mpu6050_dev_t *dev);
+
+/* Connects the auxiliary bus to the host bus, e.g. to configure a magnetometer
+   with its own driver; must be disabled before enabling the auxiliary master. */
+int mpu6050_aux_bypass(mpu6050_dev_t *dev, int enable);
+
+/* Adds a block read of an auxiliary device, executed by the MPU6050 every
+   (1 + delay) samples, where delay is shared by all slaves. The data is copied
+   to buf by each mpu6050_read(), which then covers accelerometer, temperature,
+   gyroscope and auxiliary data in one burst. */
+int mpu6050_aux_add_read(mpu6050_dev_t *dev, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len, uint8_t delay);
+
 
 #endif /* __MPU6050_H__ */
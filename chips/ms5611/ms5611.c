@@ -33,16 +33,65 @@
 
 
 
-static const int conv_time_ms[5] =
+/* allowance for the delay between the time passed to ms5611_poll and the conversion start, in ns: */
+#define CONV_MARGIN 200000
+
+/* maximum conversion times in ns: */
+static const uint32_t conv_time[5] =
 {
-   1 /* 0.60ms */,
-   2 /* 1.17 */,
-   3 /* 2.28 */,
-   5 /* 4.54 */,
-   10 /* 9.04 */
+   600000,
+   1170000,
+   2280000,
+   4540000,
+   9040000
 };
 
 
+/* altitude lookup table, covering the pressure range of the sensor: */
+#define ALT_TABLE_MIN 10000 /* Pa */
+#define ALT_TABLE_STEP 64 /* Pa */
+#define ALT_TABLE_SIZE ((120000 - ALT_TABLE_MIN) / ALT_TABLE_STEP + 2)
+
+static float alt_table[ALT_TABLE_SIZE];
+static int alt_table_ready = 0;
+
+
+static double ms5611_altitude_exact(double p)
+{
+   return 44330.0 * (1.0 - pow(p / 101325.0, 0.190295));
+}
+
+
+static void ms5611_alt_table_init(void)
+{
+   if (alt_table_ready)
+   {
+      return;
+   }
+   int i;
+   for (i = 0; i < ALT_TABLE_SIZE; i++)
+   {
+      alt_table[i] = ms5611_altitude_exact(ALT_TABLE_MIN + i * ALT_TABLE_STEP);
+   }
+   alt_table_ready = 1;
+}
+
+
+/* converts pressure to altitude by linear interpolation in the lookup table;
+   the interpolation error is below 1cm above 30kPa and below 3cm at 10kPa: */
+static double ms5611_altitude(double p)
+{
+   double pos = (p - ALT_TABLE_MIN) / ALT_TABLE_STEP;
+   if (pos < 0.0 || pos >= ALT_TABLE_SIZE - 1)
+   {
+      return ms5611_altitude_exact(p); /* out of the sensor's range */
+   }
+   int i = (int)pos;
+   float frac = pos - i;
+   return alt_table[i] + frac * (alt_table[i + 1] - alt_table[i]);
+}
+
+
 /* reads prom register into val and returns 0
  * if the read failed, val remains untouched
  * and a negative error code is returned */
@@ -61,7 +110,7 @@ out:
 }
 
 
-static int ms5611_read_adc(uint32_t *val, ms5611_dev_t *dev)
+static int ms5611_read_adc(int32_t *val, ms5611_dev_t *dev)
 {
    uint8_t raw[3]; /* 24-bit adc data */
    int ret = i2c_read_block_reg(&dev->i2c_dev, MS5611_ADC, raw, sizeof(raw));
@@ -141,6 +190,11 @@ int ms5611_init(ms5611_dev_t *dev, i2c_bus_t *bus, ms5611_osr_t p_osr, ms5611_os
    /* assign over-sampling settings: */
    dev->p_osr = p_osr;
    dev->t_osr = t_osr;
+   dev->state = MS5611_IDLE;
+   dev->deadline = 0;
+   dev->t_interval = 1;
+   dev->p_count = 0;
+   ms5611_alt_table_init();
 
    /* reset device: */
    int ret = ms5611_reset(dev);
@@ -216,43 +270,110 @@ static void ms5611_compensate(ms5611_dev_t *dev)
 
    /* compute compensated pressure: */
    dev->c_p = (((D1 * SENS) >> 21) - OFF) >> 15;
-   dev->c_a = (44330.0 * (1.0 - pow((float)dev->c_p / 101325.0, 0.190295)));
+   dev->c_a = ms5611_altitude(dev->c_p);
    dev->c_t = (float)TEMP / 100.0;
 }
 
 
-int ms5611_measure(ms5611_dev_t *dev)
+/* reads a finished conversion; a zero result means the conversion
+   was not complete, e.g. after a late start, and yields -EAGAIN */
+static int ms5611_read_conv(int32_t *val, ms5611_dev_t *dev)
 {
-   /* read pressure: */
-   int ret = ms5611_start_pressure_conv(dev);
-   if (ret < 0)
+   int ret = ms5611_read_adc(val, dev);
+   if (ret == 0 && *val == 0)
    {
-      goto out;   
+      ret = -EAGAIN;
    }
-   sleep_ms(conv_time_ms[dev->p_osr]);
-   ret = ms5611_read_adc(&dev->raw_p, dev);
-   if (ret < 0)
+   return ret;
+}
+
+
+void ms5611_set_temp_interval(ms5611_dev_t *dev, unsigned int t_interval)
+{
+   dev->t_interval = t_interval > 0 ? t_interval : 1;
+}
+
+
+int ms5611_poll(ms5611_dev_t *dev, uint64_t now)
+{
+   int ret = 0;
+   if (now < dev->deadline)
    {
-      goto out;   
+      goto out;
    }
+   switch (dev->state)
+   {
+      case MS5611_CONV_P:
+         ret = ms5611_read_conv(&dev->raw_p, dev);
+         if (ret < 0)
+         {
+            goto restart;
+         }
+         ms5611_compensate(dev);
+         if (++dev->p_count >= dev->t_interval)
+         {
+            goto start_temp;
+         }
+         goto start_pressure;
 
-   /* read temperature: */
-   ret = ms5611_start_temp_conv(dev);
+      case MS5611_CONV_T:
+         ret = ms5611_read_conv(&dev->raw_t, dev);
+         if (ret < 0)
+         {
+            goto restart;
+         }
+         dev->p_count = 0;
+         goto start_pressure;
+
+      default:
+         goto start_temp;
+   }
+
+start_pressure:
+   ret = ms5611_start_pressure_conv(dev);
    if (ret < 0)
    {
-      goto out;   
+      goto restart;
    }
-   sleep_ms(conv_time_ms[dev->t_osr]);
-   ret = ms5611_read_adc(&dev->raw_t, dev);
+   dev->deadline = now + conv_time[dev->p_osr] + CONV_MARGIN;
+   ret = dev->state == MS5611_CONV_P; /* a pressure has just been compensated */
+   dev->state = MS5611_CONV_P;
+   goto out;
+
+start_temp:
+   ret = ms5611_start_temp_conv(dev);
    if (ret < 0)
    {
-      goto out;   
+      goto restart;
    }
-   ms5611_compensate(dev);
+   dev->deadline = now + conv_time[dev->t_osr] + CONV_MARGIN;
+   ret = dev->state == MS5611_CONV_P;
+   dev->state = MS5611_CONV_T;
 
 out:
    return ret;
+
+restart:
+   /* begin the next step with a new temperature conversion: */
+   dev->state = MS5611_IDLE;
+   return ret;
 }
 
 
+int ms5611_measure(ms5611_dev_t *dev)
+{
+   int ret;
+   do
+   {
+      uint64_t now = monotonic_raw_ns();
+      if (now < dev->deadline)
+      {
+         sleep_ns(dev->deadline - now);
+         now = monotonic_raw_ns();
+      }
+      ret = ms5611_poll(dev, now);
+   }
+   while (ret == 0);
+   return ret < 0 ? ret : 0;
+}
 
@@ -37,6 +37,16 @@ typedef enum
 ms5611_osr_t;
 
 
+/* measurement states: */
+typedef enum
+{
+   MS5611_IDLE,
+   MS5611_CONV_P, /* pressure conversion running */
+   MS5611_CONV_T /* temperature conversion running */
+}
+ms5611_state_t;
+
+
 typedef struct
 {
    /* i2c device: */
@@ -46,6 +56,12 @@ typedef struct
    ms5611_osr_t p_osr;
    ms5611_osr_t t_osr;
 
+   /* measurement state machine: */
+   ms5611_state_t state;
+   uint64_t deadline; /* monotonic_raw_ns() time when the next step is due */
+   unsigned int t_interval; /* pressure conversions per temperature conversion */
+   unsigned int p_count; /* pressure conversions since the last temperature conversion */
+
    /* PROM data: */
    uint16_t prom[8];
 
@@ -63,9 +79,20 @@ ms5611_dev_t;
 
 int ms5611_init(ms5611_dev_t *dev, i2c_bus_t *bus, ms5611_osr_t p_osr, ms5611_osr_t t_osr);
 
+/* refreshes the temperature only every t_interval pressure conversions (default 1);
+   temperature changes slowly, so larger intervals raise the pressure rate up to twofold */
+void ms5611_set_temp_interval(ms5611_dev_t *dev, unsigned int t_interval);
 
+
+/* blocking measurement of pressure and temperature: */
 int ms5611_measure(ms5611_dev_t *dev);
 
+/* advances the measurement without blocking if dev->deadline has passed:
+   reads a finished conversion and starts the next one;
+   returns 1 if a new pressure has been compensated, 0 if not
+   or a negative error code; now is monotonic_raw_ns() time */
+int ms5611_poll(ms5611_dev_t *dev, uint64_t now);
+
 
 #endif /* __MS5611_H__ */
 
@@ -0,0 +1,223 @@
+
+/*
+   Sensor Registry Implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "sensor.h"
+
+
+int sensor_registry_init(sensor_registry_t *reg, const sensor_desc_t *board, size_t n)
+{
+   int ret = 0;
+   reg->n = 0;
+   reg->n_batches = 0;
+   if (n > SENSOR_MAX)
+   {
+      return -ENOMEM;
+   }
+   size_t i;
+   for (i = 0; i < n; i++)
+   {
+      sensor_t *sensor = &reg->sensors[reg->n];
+      sensor->driver = sensor_driver_find(board[i].driver);
+      if (sensor->driver == NULL)
+      {
+         ret = -ENODEV;
+         goto out;
+      }
+      sensor->dev = calloc(1, sensor->driver->size);
+      if (sensor->dev == NULL)
+      {
+         ret = -ENOMEM;
+         goto out;
+      }
+      sensor->bus = board[i].bus;
+      sensor->period = 0;
+      sensor->last = 0;
+      sensor->queued = 0;
+      sensor->time = 0;
+      sensor->mag_cal = NULL;
+      ret = sensor->driver->init(sensor, board[i].bus);
+      if (ret < 0)
+      {
+         free(sensor->dev);
+         if (board[i].optional)
+         {
+            ret = 0;
+            continue;
+         }
+         goto out;
+      }
+      reg->n++;
+   }
+
+out:
+   if (ret < 0)
+   {
+      sensor_registry_close(reg);
+   }
+   return ret;
+}
+
+
+sensor_t *sensor_registry_find(sensor_registry_t *reg, uint32_t caps)
+{
+   size_t i;
+   for (i = 0; i < reg->n; i++)
+   {
+      if ((reg->sensors[i].driver->caps & caps) == caps)
+      {
+         return &reg->sensors[i];
+      }
+   }
+   return NULL;
+}
+
+
+static i2c_batch_t *batch_for_bus(sensor_registry_t *reg, i2c_bus_t *bus)
+{
+   size_t i;
+   for (i = 0; i < reg->n_batches; i++)
+   {
+      if (reg->batches[i].bus == bus)
+      {
+         return &reg->batches[i];
+      }
+   }
+   i2c_batch_t *batch = &reg->batches[reg->n_batches++];
+   i2c_batch_init(batch, bus);
+   return batch;
+}
+
+
+static int due(const sensor_t *sensor, uint64_t now)
+{
+   return sensor->last == 0 || now - sensor->last >= sensor->period / 2;
+}
+
+
+int sensor_registry_read(sensor_registry_t *reg, uint64_t now)
+{
+   int ret = 0;
+   size_t i, j;
+
+   /* build the transfers of the due sensors: */
+   for (i = 0; i < reg->n_batches; i++)
+   {
+      i2c_batch_init(&reg->batches[i], reg->batches[i].bus);
+   }
+   for (i = 0; i < reg->n; i++)
+   {
+      sensor_t *sensor = &reg->sensors[i];
+      sensor->queued = 0;
+      if (sensor->driver->queue != NULL && due(sensor, now))
+      {
+         sensor->queued = sensor->driver->queue(sensor, batch_for_bus(reg, sensor->bus)) == 0;
+      }
+   }
+
+   /* run them: */
+   for (i = 0; i < reg->n_batches; i++)
+   {
+      i2c_batch_t *batch = &reg->batches[i];
+      if (batch->n == 0)
+      {
+         continue;
+      }
+      int err = i2c_batch_run(batch);
+      for (j = 0; j < reg->n; j++)
+      {
+         sensor_t *sensor = &reg->sensors[j];
+         if (sensor->bus == batch->bus && sensor->queued)
+         {
+            /* nothing to parse for the sensors of this bus on failure: */
+            sensor->queued = err == 0;
+            sensor->time = batch->time;
+         }
+      }
+      if (err < 0 && ret == 0)
+      {
+         ret = err;
+      }
+   }
+   return ret;
+}
+
+
+int sensor_registry_update(sensor_registry_t *reg, uint64_t now, sensor_sample_t *sample)
+{
+   sample->time = now;
+   sample->fresh = 0;
+   size_t i;
+   for (i = 0; i < reg->n; i++)
+   {
+      sensor_t *sensor = &reg->sensors[i];
+      int ret;
+      uint64_t time;
+      if (sensor->driver->queue != NULL)
+      {
+         if (!sensor->queued)
+         {
+            continue;
+         }
+         ret = sensor->driver->parse(sensor, sample);
+         time = sensor->time;
+      }
+      else
+      {
+         ret = sensor->driver->poll(sensor, now, sample);
+         time = now;
+      }
+      if (ret == 1)
+      {
+         uint32_t caps = sensor->driver->caps;
+         sensor->last = time;
+         sample->fresh |= caps;
+         if (caps & SENSOR_GYRO)
+         {
+            sample->gyro_time = time;
+         }
+         if (caps & SENSOR_ACC)
+         {
+            sample->acc_time = time;
+         }
+         if (caps & SENSOR_MAG)
+         {
+            sample->mag_time = time;
+         }
+         if (caps & SENSOR_BARO)
+         {
+            sample->baro_time = time;
+         }
+      }
+   }
+   return sample->fresh;
+}
+
+
+void sensor_registry_close(sensor_registry_t *reg)
+{
+   size_t i;
+   for (i = 0; i < reg->n; i++)
+   {
+      free(reg->sensors[i].dev);
+   }
+   reg->n = 0;
+}
+
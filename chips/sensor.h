@@ -0,0 +1,156 @@
+
+/*
+   Sensor Interface and Registry
+
+   Common interface of the sensor drivers: each driver describes its
+   capabilities and native output period and either adds its registers
+   to a combined transfer (queue/parse) or advances its own state
+   machine (poll). The registry instantiates drivers from a board
+   description, schedules the reads of due sensors and merges their
+   results into one timestamped sample.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __SENSOR_H__
+#define __SENSOR_H__
+
+
+#include <stdint.h>
+
+#include "../i2c/i2c.h"
+#include "../util/math.h"
+#include "../util/mag_cal.h"
+
+
+/* maximum number of sensors of a board: */
+#define SENSOR_MAX 8
+
+
+/* capabilities: */
+#define SENSOR_GYRO (1 << 0) /* angular rate in rad/s */
+#define SENSOR_ACC  (1 << 1) /* acceleration in m/s^2 */
+#define SENSOR_MAG  (1 << 2) /* calibrated magnetic field, in driver units */
+#define SENSOR_BARO (1 << 3) /* pressure in Pa and altitude in m */
+
+
+/* merged measurements of all sensors;
+   each measurement carries the time its transfer completed, in ns: */
+typedef struct
+{
+   uint64_t time; /* of the update in ns */
+   uint32_t fresh; /* capabilities updated by the last call */
+   uint64_t gyro_time;
+   vec3_t gyro;
+   uint64_t acc_time;
+   vec3_t acc;
+   uint64_t mag_time;
+   vec3_t mag;
+   vec3_t mag_raw; /* uncalibrated, e.g. for an online calibration */
+   uint64_t baro_time;
+   float pressure;
+   float altitude;
+}
+sensor_sample_t;
+
+
+typedef struct sensor sensor_t;
+
+
+typedef struct
+{
+   const char *name;
+   uint32_t caps;
+   size_t size; /* of the driver state */
+
+   /* initializes the device and sets sensor->period: */
+   int (*init)(sensor_t *sensor, i2c_bus_t *bus);
+
+   /* adds the data registers to a batch; the results are stored by parse,
+      which returns 1 for fresh data, 0 for stale data or a negative error code: */
+   int (*queue)(sensor_t *sensor, i2c_batch_t *batch);
+   int (*parse)(sensor_t *sensor, sensor_sample_t *sample);
+
+   /* used instead of queue/parse by sensors with own state machines,
+      returns like parse; now is monotonic_raw_ns() time: */
+   int (*poll)(sensor_t *sensor, uint64_t now, sensor_sample_t *sample);
+
+   /* enables the data-ready interrupt, optional: */
+   int (*int_enable)(sensor_t *sensor);
+}
+sensor_driver_t;
+
+
+struct sensor
+{
+   const sensor_driver_t *driver;
+   void *dev; /* driver state, e.g. itg3200_dev_t */
+   i2c_dev_t *i2c_dev; /* of the chip, set by init */
+   mag_cal_pub_t *mag_cal; /* calibration applied by a magnetometer driver, NULL if none */
+   i2c_bus_t *bus;
+   uint64_t period; /* native output period in ns, 0 if paced by poll */
+   uint64_t last; /* time of the last fresh sample */
+   int queued; /* registers are part of the current transfer */
+   uint64_t time; /* completion of the current transfer */
+};
+
+
+/* board description entry: */
+typedef struct
+{
+   const char *driver;
+   i2c_bus_t *bus;
+   int optional; /* a failing init drops the sensor instead of failing the board */
+}
+sensor_desc_t;
+
+
+typedef struct
+{
+   sensor_t sensors[SENSOR_MAX];
+   size_t n;
+
+   /* one combined transfer per bus: */
+   i2c_batch_t batches[SENSOR_MAX];
+   size_t n_batches;
+}
+sensor_registry_t;
+
+
+/* returns the driver of the given name or NULL */
+const sensor_driver_t *sensor_driver_find(const char *name);
+
+/* instantiates and initializes the sensors of a board */
+int sensor_registry_init(sensor_registry_t *reg, const sensor_desc_t *board, size_t n);
+
+/* returns the first sensor providing all given capabilities or NULL */
+sensor_t *sensor_registry_find(sensor_registry_t *reg, uint32_t caps);
+
+/* reads the registers of all due sensors, one combined transfer per bus;
+   a sensor is due once half of its period has passed since its last fresh sample.
+   returns 0 or the first error; now is the time in ns on the clock of the
+   transfer timestamps, monotonic_raw_ns() or the recorded time of a replay */
+int sensor_registry_read(sensor_registry_t *reg, uint64_t now);
+
+/* parses the data read and polls the other sensors into sample, which keeps
+   the values of sensors without new data; returns the fresh capabilities.
+   parsed data is stamped with the completion time of its transfer, polled
+   data with now, which is on the same clock as for sensor_registry_read */
+int sensor_registry_update(sensor_registry_t *reg, uint64_t now, sensor_sample_t *sample);
+
+void sensor_registry_close(sensor_registry_t *reg);
+
+
+#endif /* __SENSOR_H__ */
+
@@ -0,0 +1,291 @@
+
+/*
+   Sensor Interface Adapters of the Chip Drivers
+
+   Each adapter initializes its chip in the standard configuration
+   of PenguAHRS and converts the results to the units of sensor.h.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <math.h>
+#include <string.h>
+
+#include "sensor.h"
+#include "itg3200/itg3200.h"
+#include "bma180/bma180.h"
+#include "hmc5883/hmc5883.h"
+#include "ms5611/ms5611.h"
+#include "mpu6050/mpu6050.h"
+
+
+
+/* ITG3200: */
+
+static int itg3200_sensor_init(sensor_t *sensor, i2c_bus_t *bus)
+{
+   sensor->i2c_dev = &((itg3200_dev_t *)sensor->dev)->i2c_dev;
+   sensor->period = 1000000; /* 1kHz internal sample rate with DLPF */
+   return itg3200_init(sensor->dev, bus, ITG3200_DLPF_42HZ);
+}
+
+
+static int itg3200_sensor_queue(sensor_t *sensor, i2c_batch_t *batch)
+{
+   return itg3200_queue_gyro(sensor->dev, batch);
+}
+
+
+static int itg3200_sensor_parse(sensor_t *sensor, sensor_sample_t *sample)
+{
+   itg3200_dev_t *dev = sensor->dev;
+   int ret = itg3200_parse_gyro(dev);
+   if (ret == 1)
+   {
+      memcpy(sample->gyro.vec, dev->gyro.data, sizeof(sample->gyro.vec));
+   }
+   return ret;
+}
+
+
+static int itg3200_sensor_int_enable(sensor_t *sensor)
+{
+   return itg3200_int_enable(sensor->dev);
+}
+
+
+static const sensor_driver_t itg3200_sensor =
+{
+   "itg3200",
+   SENSOR_GYRO,
+   sizeof(itg3200_dev_t),
+   itg3200_sensor_init,
+   itg3200_sensor_queue,
+   itg3200_sensor_parse,
+   NULL,
+   itg3200_sensor_int_enable
+};
+
+
+
+/* BMA180: */
+
+/* filter bandwidths in Hz, the output rate is twice the bandwidth: */
+static const uint32_t bma180_bw_tab[] = {10, 20, 40, 75, 150, 300, 600, 1200, 1200, 1200};
+
+
+static int bma180_sensor_init(sensor_t *sensor, i2c_bus_t *bus)
+{
+   sensor->i2c_dev = &((bma180_dev_t *)sensor->dev)->i2c_dev;
+   bma180_bw_t bw = BMA180_BW_10HZ;
+   sensor->period = 500000000 / bma180_bw_tab[bw];
+   return bma180_init(sensor->dev, bus, BMA180_RANGE_4G, bw);
+}
+
+
+static int bma180_sensor_queue(sensor_t *sensor, i2c_batch_t *batch)
+{
+   return bma180_queue_acc(sensor->dev, batch);
+}
+
+
+static int bma180_sensor_parse(sensor_t *sensor, sensor_sample_t *sample)
+{
+   bma180_dev_t *dev = sensor->dev;
+   int ret = bma180_parse_acc(dev);
+   if (ret == 1)
+   {
+      sample->acc = dev->raw;
+   }
+   return ret;
+}
+
+
+static const sensor_driver_t bma180_sensor =
+{
+   "bma180",
+   SENSOR_ACC,
+   sizeof(bma180_dev_t),
+   bma180_sensor_init,
+   bma180_sensor_queue,
+   bma180_sensor_parse,
+   NULL,
+   NULL
+};
+
+
+
+/* HMC5883: */
+
+static int hmc5883_sensor_init(sensor_t *sensor, i2c_bus_t *bus)
+{
+   sensor->i2c_dev = &((hmc5883_dev_t *)sensor->dev)->i2c_dev;
+   sensor->mag_cal = &((hmc5883_dev_t *)sensor->dev)->cal;
+   sensor->period = HMC5883_PERIOD;
+   return hmc5883_init(sensor->dev, bus);
+}
+
+
+static int hmc5883_sensor_queue(sensor_t *sensor, i2c_batch_t *batch)
+{
+   return hmc5883_queue(sensor->dev, batch);
+}
+
+
+static int hmc5883_sensor_parse(sensor_t *sensor, sensor_sample_t *sample)
+{
+   hmc5883_dev_t *dev = sensor->dev;
+   int ret = hmc5883_parse(dev);
+   if (ret == 1)
+   {
+      sample->mag = dev->mag;
+      sample->mag_raw = dev->raw;
+   }
+   return ret;
+}
+
+
+static const sensor_driver_t hmc5883_sensor =
+{
+   "hmc5883",
+   SENSOR_MAG,
+   sizeof(hmc5883_dev_t),
+   hmc5883_sensor_init,
+   hmc5883_sensor_queue,
+   hmc5883_sensor_parse,
+   NULL,
+   NULL
+};
+
+
+
+/* MS5611: */
+
+static int ms5611_sensor_init(sensor_t *sensor, i2c_bus_t *bus)
+{
+   sensor->i2c_dev = &((ms5611_dev_t *)sensor->dev)->i2c_dev;
+   sensor->period = 0; /* paced by its conversions */
+   int ret = ms5611_init(sensor->dev, bus, MS5611_OSR4096, MS5611_OSR4096);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   ms5611_set_temp_interval(sensor->dev, 10);
+   return ret;
+}
+
+
+static int ms5611_sensor_poll(sensor_t *sensor, uint64_t now, sensor_sample_t *sample)
+{
+   ms5611_dev_t *dev = sensor->dev;
+   int ret = ms5611_poll(dev, now);
+   if (ret == 1)
+   {
+      sample->pressure = dev->c_p;
+      sample->altitude = dev->c_a;
+   }
+   return ret;
+}
+
+
+static const sensor_driver_t ms5611_sensor =
+{
+   "ms5611",
+   SENSOR_BARO,
+   sizeof(ms5611_dev_t),
+   ms5611_sensor_init,
+   NULL,
+   NULL,
+   ms5611_sensor_poll,
+   NULL
+};
+
+
+
+/* MPU6050: */
+
+static int mpu6050_sensor_init(sensor_t *sensor, i2c_bus_t *bus)
+{
+   sensor->i2c_dev = &((mpu6050_dev_t *)sensor->dev)->i2c_dev;
+   sensor->period = 1000000; /* 1kHz with DLPF */
+   return mpu6050_init(sensor->dev, bus, MPU6050_DLPF_CFG_94_98Hz, MPU6050_FS_SEL_500, MPU6050_AFS_SEL_4G);
+}
+
+
+static int mpu6050_sensor_queue(sensor_t *sensor, i2c_batch_t *batch)
+{
+   return mpu6050_queue(sensor->dev, batch);
+}
+
+
+static int mpu6050_sensor_parse(sensor_t *sensor, sensor_sample_t *sample)
+{
+   mpu6050_dev_t *dev = sensor->dev;
+   int ret = mpu6050_parse(dev);
+   if (ret == 1)
+   {
+      int i;
+      for (i = 0; i < 3; i++)
+      {
+         sample->gyro.vec[i] = dev->gyro.vec[i] * M_PI / 180.0;
+         sample->acc.vec[i] = dev->acc.vec[i] * 9.81;
+      }
+   }
+   return ret;
+}
+
+
+static int mpu6050_sensor_int_enable(sensor_t *sensor)
+{
+   return mpu6050_int_enable(sensor->dev);
+}
+
+
+static const sensor_driver_t mpu6050_sensor =
+{
+   "mpu6050",
+   SENSOR_GYRO | SENSOR_ACC,
+   sizeof(mpu6050_dev_t),
+   mpu6050_sensor_init,
+   mpu6050_sensor_queue,
+   mpu6050_sensor_parse,
+   NULL,
+   mpu6050_sensor_int_enable
+};
+
+
+
+static const sensor_driver_t *drivers[] =
+{
+   &itg3200_sensor,
+   &bma180_sensor,
+   &hmc5883_sensor,
+   &ms5611_sensor,
+   &mpu6050_sensor
+};
+
+
+const sensor_driver_t *sensor_driver_find(const char *name)
+{
+   size_t i;
+   for (i = 0; i < sizeof(drivers) / sizeof(drivers[0]); i++)
+   {
+      if (strcmp(drivers[i]->name, name) == 0)
+      {
+         return drivers[i];
+      }
+   }
+   return NULL;
+}
+
@@ -20,9 +20,164 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "i2c.h"
 #include "i2c-dev.h"
+#include "i2c_trace.h"
+#include "../util/interval.h"
+
+
+/* linux i2c-dev backend: */
+
+static int set_slave_address_if_needed(i2c_bus_t *bus, uint8_t addr)
+{
+   int ret = 0;
+   if (bus->dev_addr != addr)
+   {
+      ret = ioctl(bus->handle, I2C_SLAVE, addr);
+      if (ret < 0)
+      {
+         return ret;
+      }
+      bus->dev_addr = addr;
+   }
+   return ret;
+}
+
+
+static int linux_write(i2c_bus_t *bus, uint8_t addr, uint8_t val)
+{
+   int ret = set_slave_address_if_needed(bus, addr);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return i2c_smbus_write_byte(bus->handle, val);
+}
+
+
+static int linux_write_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg, uint8_t val)
+{
+   int ret = set_slave_address_if_needed(bus, addr);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return i2c_smbus_write_byte_data(bus->handle, reg, val);
+}
+
+
+static int linux_read(i2c_bus_t *bus, uint8_t addr)
+{
+   int ret = set_slave_address_if_needed(bus, addr);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return i2c_smbus_read_byte(bus->handle);
+}
+
+
+static int linux_read_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg)
+{
+   int ret = set_slave_address_if_needed(bus, addr);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return i2c_smbus_read_byte_data(bus->handle, reg);
+}
+
+
+static int linux_read_block_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len)
+{
+   if (len > I2C_SMBUS_I2C_BLOCK_MAX)
+   {
+      /* too long for smbus, e.g. FIFO bursts; use a combined transfer: */
+      struct i2c_msg msgs[2];
+      msgs[0].addr = addr;
+      msgs[0].flags = 0;
+      msgs[0].len = 1;
+      msgs[0].buf = (char *)&reg;
+      msgs[1].addr = addr;
+      msgs[1].flags = I2C_M_RD;
+      msgs[1].len = len;
+      msgs[1].buf = (char *)buf;
+      struct i2c_rdwr_ioctl_data data;
+      data.msgs = msgs;
+      data.nmsgs = 2;
+      return ioctl(bus->handle, I2C_RDWR, &data) == 2 ? 0 : -EIO;
+   }
+   int ret = set_slave_address_if_needed(bus, addr);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return i2c_smbus_read_i2c_block_data(bus->handle, reg, len, buf) == (int)len ? 0 : -EIO;
+}
+
+
+/* all reads are combined into a single I2C_RDWR transfer with repeated starts,
+   addressing each message directly without I2C_SLAVE switches: */
+static int linux_read_batch(i2c_bus_t *bus, i2c_batch_t *batch)
+{
+   struct i2c_msg msgs[2 * I2C_BATCH_MAX];
+   size_t i;
+   for (i = 0; i < batch->n; i++)
+   {
+      msgs[2 * i].addr = batch->reads[i].addr;
+      msgs[2 * i].flags = 0;
+      msgs[2 * i].len = 1;
+      msgs[2 * i].buf = (char *)&batch->reads[i].reg;
+      msgs[2 * i + 1].addr = batch->reads[i].addr;
+      msgs[2 * i + 1].flags = I2C_M_RD;
+      msgs[2 * i + 1].len = batch->reads[i].len;
+      msgs[2 * i + 1].buf = (char *)batch->reads[i].buf;
+   }
+   struct i2c_rdwr_ioctl_data data;
+   data.msgs = msgs;
+   data.nmsgs = 2 * batch->n;
+   return ioctl(bus->handle, I2C_RDWR, &data) == data.nmsgs ? 0 : -EIO;
+}
+
+
+static int linux_close(i2c_bus_t *bus)
+{
+   return close(bus->handle);
+}
+
+
+static const i2c_backend_t linux_backend =
+{
+   linux_write,
+   linux_write_reg,
+   linux_read,
+   linux_read_reg,
+   linux_read_block_reg,
+   linux_read_batch,
+   linux_close
+};
+
+
+
+/* generic bus interface: */
+
+int i2c_bus_init(i2c_bus_t *bus, const i2c_backend_t *backend, void *priv)
+{
+   bus->backend = backend;
+   bus->priv = priv;
+   bus->handle = -1;
+   bus->dev_addr = 0xFF;
+   bus->trace = NULL;
+   bus->stats = calloc(1, sizeof(i2c_stats_t));
+   if (bus->stats != NULL)
+   {
+      bus->stats->last_addr = 0xFF;
+   }
+   return pthread_mutex_init(&bus->mutex, NULL);
+}
 
 
 int i2c_bus_open(i2c_bus_t *bus, char *path)
@@ -32,15 +187,24 @@ int i2c_bus_open(i2c_bus_t *bus, char *path)
    {
       return handle;   
    }
-   bus->dev_addr = 0xFF;
+   int ret = i2c_bus_init(bus, &linux_backend, NULL);
    bus->handle = handle;
-   return pthread_mutex_init(&bus->mutex, NULL);
+   return ret;
 }
 
 
 int i2c_bus_close(i2c_bus_t *bus)
 {
-   return close(bus->handle);
+   int ret = bus->backend->close(bus);
+   pthread_mutex_destroy(&bus->mutex);
+   free(bus->stats);
+   bus->stats = NULL;
+   if (bus->trace != NULL)
+   {
+      fclose(bus->trace);
+      bus->trace = NULL;
+   }
+   return ret;
 }
 
 
@@ -51,108 +215,202 @@ void i2c_dev_init(i2c_dev_t *dev, i2c_bus_t *bus, uint8_t addr)
 }
 
 
-static void i2c_dev_lock_bus(i2c_dev_t *dev)
+int i2c_bus_stats(i2c_bus_t *bus, i2c_stats_t *snapshot)
 {
-   pthread_mutex_lock(&dev->bus->mutex);
+   if (bus->stats == NULL)
+   {
+      return -ENOMEM;
+   }
+   pthread_mutex_lock(&bus->mutex);
+   memcpy(snapshot, bus->stats, sizeof(i2c_stats_t));
+   pthread_mutex_unlock(&bus->mutex);
+   return 0;
 }
 
 
-static void i2c_dev_unlock_bus(i2c_dev_t *dev)
+void i2c_bus_stats_reset(i2c_bus_t *bus)
 {
-   pthread_mutex_unlock(&dev->bus->mutex);
+   if (bus->stats != NULL)
+   {
+      pthread_mutex_lock(&bus->mutex);
+      memset(bus->stats, 0, sizeof(i2c_stats_t));
+      bus->stats->last_addr = bus->dev_addr;
+      pthread_mutex_unlock(&bus->mutex);
+   }
 }
 
 
-static int set_slave_address_if_needed(i2c_dev_t *dev)
+int i2c_bus_record(i2c_bus_t *bus, const char *path)
 {
-   int ret = 0;
-   if (dev->bus->dev_addr != dev->addr)
+   FILE *trace = i2c_trace_create(path);
+   if (trace == NULL)
    {
-      ret = ioctl(dev->bus->handle, I2C_SLAVE, dev->addr);
-      if (ret < 0)
-      {
-         return ret;
-      }
-      dev->bus->dev_addr = dev->addr;
+      return -errno;
    }
-   return ret;
+   pthread_mutex_lock(&bus->mutex);
+   FILE *prev = bus->trace;
+   bus->trace = trace;
+   pthread_mutex_unlock(&bus->mutex);
+   if (prev != NULL)
+   {
+      fclose(prev);
+   }
+   return 0;
 }
 
 
-int i2c_write(i2c_dev_t *dev, uint8_t val)
+/* locks the bus, returns the time the lock was taken
+   and stores the time spent waiting for it: */
+static uint64_t lock_bus(i2c_bus_t *bus, uint64_t *wait)
 {
-   i2c_dev_lock_bus(dev);
-   int ret = set_slave_address_if_needed(dev);
-   if (ret < 0)
+   uint64_t request = monotonic_ns();
+   pthread_mutex_lock(&bus->mutex);
+   uint64_t start = monotonic_ns();
+   *wait = start - request;
+   return start;
+}
+
+
+/* records the transaction with its completion time and unlocks the bus: */
+static void unlock_bus(i2c_bus_t *bus, i2c_trace_op_t op, uint8_t addr, uint8_t reg,
+                       const uint8_t *data, size_t len, int ret, uint64_t wait, uint64_t start)
+{
+   if (bus->trace != NULL)
+   {
+      i2c_trace_write(bus->trace, monotonic_raw_ns(), op, addr, reg, ret, data, len);
+   }
+   if (bus->stats != NULL)
    {
-      goto out;
+      int write = op == I2C_TRACE_WRITE || op == I2C_TRACE_WRITE_REG;
+      i2c_stats_record(bus->stats, write, addr, reg, len, ret, wait, monotonic_ns() - start);
    }
-   ret = i2c_smbus_write_byte(dev->bus->handle, val);
-out:
-   i2c_dev_unlock_bus(dev);
+   pthread_mutex_unlock(&bus->mutex);
+}
+
+
+int i2c_write(i2c_dev_t *dev, uint8_t val)
+{
+   uint64_t wait;
+   uint64_t start = lock_bus(dev->bus, &wait);
+   int ret = dev->bus->backend->write(dev->bus, dev->addr, val);
+   unlock_bus(dev->bus, I2C_TRACE_WRITE, dev->addr, I2C_STATS_NO_REG, &val, 1, ret, wait, start);
    return ret;
 }
 
 
 int i2c_write_reg(i2c_dev_t *dev, uint8_t reg, uint8_t val)
 {
-   i2c_dev_lock_bus(dev);
-   int ret = set_slave_address_if_needed(dev);
-   if (ret < 0)
-   {
-      goto out;
-   }
-   ret = i2c_smbus_write_byte_data(dev->bus->handle, reg, val);
-out:
-   i2c_dev_unlock_bus(dev);
+   uint64_t wait;
+   uint64_t start = lock_bus(dev->bus, &wait);
+   int ret = dev->bus->backend->write_reg(dev->bus, dev->addr, reg, val);
+   unlock_bus(dev->bus, I2C_TRACE_WRITE_REG, dev->addr, reg, &val, 1, ret, wait, start);
    return ret;
 }
 
 
 int i2c_read(i2c_dev_t *dev)
 {
-   i2c_dev_lock_bus(dev);
-   int ret = set_slave_address_if_needed(dev);
-   if (ret < 0)
-   {
-      goto out;
-   }
-   ret =i2c_smbus_read_byte(dev->bus->handle);
-out:
-   i2c_dev_unlock_bus(dev);
+   uint64_t wait;
+   uint64_t start = lock_bus(dev->bus, &wait);
+   int ret = dev->bus->backend->read(dev->bus, dev->addr);
+   uint8_t val = ret;
+   unlock_bus(dev->bus, I2C_TRACE_READ, dev->addr, I2C_STATS_NO_REG, &val, 1, ret, wait, start);
    return ret;
 }
 
 
 int i2c_read_reg(i2c_dev_t *dev, uint8_t reg)
 {
-   i2c_dev_lock_bus(dev);
-   int ret = set_slave_address_if_needed(dev);
-   if (ret < 0)
-   {
-      goto out;
-   }
-   ret = i2c_smbus_read_byte_data(dev->bus->handle, reg);
-out:
-   i2c_dev_unlock_bus(dev);
+   uint64_t wait;
+   uint64_t start = lock_bus(dev->bus, &wait);
+   int ret = dev->bus->backend->read_reg(dev->bus, dev->addr, reg);
+   uint8_t val = ret;
+   unlock_bus(dev->bus, I2C_TRACE_READ_REG, dev->addr, reg, &val, 1, ret, wait, start);
    return ret;
 }
 
 
 int i2c_read_block_reg(i2c_dev_t *dev, uint8_t reg, uint8_t *buf, size_t len)
 {
-   i2c_dev_lock_bus(dev);
-   int ret = set_slave_address_if_needed(dev);
-   if (ret < 0)
-   {
-      goto out;
-   }
-   ret = i2c_smbus_read_i2c_block_data(dev->bus->handle, reg, len, buf) == len ? 0 : -EIO;
-out:
-   i2c_dev_unlock_bus(dev);
+   uint64_t wait;
+   uint64_t start = lock_bus(dev->bus, &wait);
+   int ret = dev->bus->backend->read_block_reg(dev->bus, dev->addr, reg, buf, len);
+   unlock_bus(dev->bus, I2C_TRACE_READ_BLOCK_REG, dev->addr, reg, buf, len, ret, wait, start);
    return ret;
 }
 
 
+void i2c_batch_init(i2c_batch_t *batch, i2c_bus_t *bus)
+{
+   batch->bus = bus;
+   batch->n = 0;
+   batch->time = 0;
+}
+
+
+int i2c_batch_add_read(i2c_batch_t *batch, i2c_dev_t *dev, uint8_t reg, uint8_t *buf, size_t len)
+{
+   if (dev->bus != batch->bus)
+   {
+      return -EINVAL;
+   }
+   if (batch->n == I2C_BATCH_MAX)
+   {
+      return -ENOMEM;
+   }
+   batch->reads[batch->n].addr = dev->addr;
+   batch->reads[batch->n].reg = reg;
+   batch->reads[batch->n].buf = buf;
+   batch->reads[batch->n].len = len;
+   batch->n++;
+   return 0;
+}
+
 
+int i2c_batch_run(i2c_batch_t *batch)
+{
+   i2c_bus_t *bus = batch->bus;
+   int ret = 0;
+   size_t i;
+   uint64_t wait;
+   uint64_t start = lock_bus(bus, &wait);
+   batch->time = 0;
+   if (bus->backend->read_batch)
+   {
+      ret = bus->backend->read_batch(bus, batch);
+   }
+   else
+   {
+      /* backend without combined transfers: */
+      for (i = 0; i < batch->n && ret == 0; i++)
+      {
+         ret = bus->backend->read_block_reg(bus, batch->reads[i].addr, batch->reads[i].reg,
+                                            batch->reads[i].buf, batch->reads[i].len);
+      }
+   }
+   /* the data is sampled when the transfer completes, unless the backend knows better: */
+   if (batch->time == 0)
+   {
+      batch->time = monotonic_raw_ns();
+   }
+   /* traced as single reads with the batch time, so a replay reproduces it;
+      a failure is attributed to the first one: */
+   size_t bytes = 0;
+   for (i = 0; i < batch->n; i++)
+   {
+      if (bus->trace != NULL && (ret == 0 || i == 0))
+      {
+         i2c_trace_write(bus->trace, batch->time, I2C_TRACE_READ_BLOCK_REG, batch->reads[i].addr,
+                         batch->reads[i].reg, ret, batch->reads[i].buf, batch->reads[i].len);
+      }
+      bytes += batch->reads[i].len;
+   }
+   /* accounted as a whole, keyed by the number of reads: */
+   if (bus->stats != NULL)
+   {
+      i2c_stats_record(bus->stats, 0, I2C_STATS_BATCH, batch->n, bytes, ret, wait, monotonic_ns() - start);
+   }
+   pthread_mutex_unlock(&bus->mutex);
+   return ret;
+}
 
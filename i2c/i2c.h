@@ -20,16 +20,42 @@
 #define __I2C_H__
 
 
+#include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <pthread.h>
 
+#include "i2c_stats.h"
 
-/* bus type definition: */
+
+struct i2c_bus;
+struct i2c_batch;
+
+
+/* bus backend operations, always called with the bus lock held: */
 typedef struct
 {
+   int (*write)(struct i2c_bus *bus, uint8_t addr, uint8_t val);
+   int (*write_reg)(struct i2c_bus *bus, uint8_t addr, uint8_t reg, uint8_t val);
+   int (*read)(struct i2c_bus *bus, uint8_t addr);
+   int (*read_reg)(struct i2c_bus *bus, uint8_t addr, uint8_t reg);
+   int (*read_block_reg)(struct i2c_bus *bus, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len);
+   int (*read_batch)(struct i2c_bus *bus, struct i2c_batch *batch); /* optional */
+   int (*close)(struct i2c_bus *bus);
+}
+i2c_backend_t;
+
+
+/* bus type definition: */
+typedef struct i2c_bus
+{
+   const i2c_backend_t *backend;
+   void *priv; /* backend private data */
    int handle;
    uint8_t dev_addr;
    pthread_mutex_t mutex;
+   i2c_stats_t *stats; /* updated with the bus lock held, may be NULL */
+   FILE *trace; /* transaction recording, see i2c_trace.h */
 }
 i2c_bus_t;
 
@@ -43,11 +69,41 @@ typedef struct
 i2c_dev_t;
 
 
+/* maximum number of reads in a batch: */
+#define I2C_BATCH_MAX 8
+
+
+/* batch of register block reads, executed as one combined transfer: */
+typedef struct i2c_batch
+{
+   i2c_bus_t *bus;
+   size_t n;
+   struct
+   {
+      uint8_t addr;
+      uint8_t reg;
+      uint8_t *buf;
+      size_t len;
+   }
+   reads[I2C_BATCH_MAX];
+   uint64_t time; /* completion of the last run, monotonic_raw_ns() */
+}
+i2c_batch_t;
+
+
 /* management: */
-int i2c_bus_open(i2c_bus_t *bus, char *path);
+int i2c_bus_init(i2c_bus_t *bus, const i2c_backend_t *backend, void *priv);
+int i2c_bus_open(i2c_bus_t *bus, char *path); /* linux i2c-dev backend */
 int i2c_bus_close(i2c_bus_t *bus);
 void i2c_dev_init(i2c_dev_t *dev, i2c_bus_t *bus, uint8_t addr);
 
+/* statistics: */
+int i2c_bus_stats(i2c_bus_t *bus, i2c_stats_t *snapshot); /* consistent copy */
+void i2c_bus_stats_reset(i2c_bus_t *bus);
+
+/* records all further transactions to a trace file until the bus is closed: */
+int i2c_bus_record(i2c_bus_t *bus, const char *path);
+
 /* writing: */
 int i2c_write(i2c_dev_t *dev, uint8_t val);
 int i2c_write_reg(i2c_dev_t *dev, uint8_t reg, uint8_t val);
@@ -57,6 +113,11 @@ int i2c_read(i2c_dev_t *dev);
 int i2c_read_reg(i2c_dev_t *dev, uint8_t reg);
 int i2c_read_block_reg(i2c_dev_t *dev, uint8_t reg, uint8_t *buf, size_t len);
 
+/* batched reading, a batch may be run any number of times: */
+void i2c_batch_init(i2c_batch_t *batch, i2c_bus_t *bus);
+int i2c_batch_add_read(i2c_batch_t *batch, i2c_dev_t *dev, uint8_t reg, uint8_t *buf, size_t len);
+int i2c_batch_run(i2c_batch_t *batch);
+
 
 #endif /* __I2C_H__ */
 
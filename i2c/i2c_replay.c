@@ -0,0 +1,294 @@
+
+/*
+   I2C Trace Replay Implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2c_replay.h"
+#include "i2c_trace.h"
+
+
+#define NO_RECORD ((size_t)-1)
+
+
+typedef struct
+{
+   uint8_t *data; /* whole trace file */
+   size_t n_recs;
+   const i2c_trace_rec_t **recs;
+   size_t *next; /* next record of the same device */
+   size_t cursor[256]; /* per device address */
+   uint64_t time[256]; /* of the last replayed record per device address */
+}
+replay_t;
+
+
+static int load(replay_t *replay, const char *path)
+{
+   int ret = 0;
+   FILE *file = fopen(path, "rb");
+   if (file == NULL)
+   {
+      return -errno;
+   }
+   fseek(file, 0, SEEK_END);
+   long size = ftell(file);
+   fseek(file, 0, SEEK_SET);
+   if (size < 8)
+   {
+      ret = -EINVAL;
+      goto out;
+   }
+   replay->data = malloc(size);
+   if (replay->data == NULL)
+   {
+      ret = -ENOMEM;
+      goto out;
+   }
+   if (fread(replay->data, 1, size, file) != (size_t)size)
+   {
+      ret = -EIO;
+      goto out;
+   }
+
+   /* check header: */
+   uint32_t version;
+   memcpy(&version, replay->data + 4, sizeof(version));
+   if (memcmp(replay->data, "I2CT", 4) != 0 || version != I2C_TRACE_VERSION)
+   {
+      ret = -EINVAL;
+      goto out;
+   }
+
+   /* count records: */
+   size_t pos = 8;
+   replay->n_recs = 0;
+   while (pos + sizeof(i2c_trace_rec_t) <= (size_t)size)
+   {
+      const i2c_trace_rec_t *rec = (const i2c_trace_rec_t *)(replay->data + pos);
+      pos += sizeof(i2c_trace_rec_t) + rec->len;
+      if (pos > (size_t)size)
+      {
+         break; /* truncated record */
+      }
+      replay->n_recs++;
+   }
+
+   /* index records and chain them per device: */
+   replay->recs = malloc(replay->n_recs * sizeof(i2c_trace_rec_t *) + 1);
+   replay->next = malloc(replay->n_recs * sizeof(size_t) + 1);
+   if (replay->recs == NULL || replay->next == NULL)
+   {
+      ret = -ENOMEM;
+      goto out;
+   }
+   size_t last[256];
+   size_t i;
+   for (i = 0; i < 256; i++)
+   {
+      replay->cursor[i] = NO_RECORD;
+      last[i] = NO_RECORD;
+   }
+   pos = 8;
+   for (i = 0; i < replay->n_recs; i++)
+   {
+      const i2c_trace_rec_t *rec = (const i2c_trace_rec_t *)(replay->data + pos);
+      replay->recs[i] = rec;
+      replay->next[i] = NO_RECORD;
+      if (last[rec->addr] == NO_RECORD)
+      {
+         replay->cursor[rec->addr] = i;
+      }
+      else
+      {
+         replay->next[last[rec->addr]] = i;
+      }
+      last[rec->addr] = i;
+      pos += sizeof(i2c_trace_rec_t) + rec->len;
+   }
+
+out:
+   fclose(file);
+   return ret;
+}
+
+
+/* takes the next record of a device and checks that it matches the transaction;
+   returns the record status, the record is returned in rec_out: */
+static int take(i2c_bus_t *bus, i2c_trace_op_t op, uint8_t addr, uint8_t reg, size_t len,
+                const i2c_trace_rec_t **rec_out)
+{
+   replay_t *replay = (replay_t *)bus->priv;
+   size_t i = replay->cursor[addr];
+   if (i == NO_RECORD)
+   {
+      return -ENODATA;
+   }
+   const i2c_trace_rec_t *rec = replay->recs[i];
+   replay->cursor[addr] = replay->next[i];
+   replay->time[addr] = rec->time;
+   if (rec->op != op || rec->reg != reg)
+   {
+      return -EPROTO; /* drivers diverged from the recording */
+   }
+   if (rec->status < 0)
+   {
+      return rec->status;
+   }
+   if (rec->len != len)
+   {
+      return -EPROTO;
+   }
+   *rec_out = rec;
+   return 0;
+}
+
+
+static const uint8_t *payload(const i2c_trace_rec_t *rec)
+{
+   return (const uint8_t *)(rec + 1);
+}
+
+
+/* the recorded payload of a write is the written byte: */
+static int replay_write(i2c_bus_t *bus, uint8_t addr, uint8_t val)
+{
+   const i2c_trace_rec_t *rec;
+   int ret = take(bus, I2C_TRACE_WRITE, addr, I2C_STATS_NO_REG, 1, &rec);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return payload(rec)[0] == val ? 0 : -EPROTO;
+}
+
+
+static int replay_write_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg, uint8_t val)
+{
+   const i2c_trace_rec_t *rec;
+   int ret = take(bus, I2C_TRACE_WRITE_REG, addr, reg, 1, &rec);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return payload(rec)[0] == val ? 0 : -EPROTO;
+}
+
+
+static int replay_read(i2c_bus_t *bus, uint8_t addr)
+{
+   const i2c_trace_rec_t *rec;
+   int ret = take(bus, I2C_TRACE_READ, addr, I2C_STATS_NO_REG, 1, &rec);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return payload(rec)[0];
+}
+
+
+static int replay_read_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg)
+{
+   const i2c_trace_rec_t *rec;
+   int ret = take(bus, I2C_TRACE_READ_REG, addr, reg, 1, &rec);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return payload(rec)[0];
+}
+
+
+static int replay_read_block_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len)
+{
+   const i2c_trace_rec_t *rec;
+   int ret = take(bus, I2C_TRACE_READ_BLOCK_REG, addr, reg, len, &rec);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   memcpy(buf, payload(rec), len);
+   return 0;
+}
+
+
+/* stamps the batch with the recorded time instead of the replay time: */
+static int replay_read_batch(i2c_bus_t *bus, i2c_batch_t *batch)
+{
+   size_t i;
+   for (i = 0; i < batch->n; i++)
+   {
+      int ret = replay_read_block_reg(bus, batch->reads[i].addr, batch->reads[i].reg,
+                                      batch->reads[i].buf, batch->reads[i].len);
+      if (ret < 0)
+      {
+         return ret;
+      }
+   }
+   if (batch->n > 0)
+   {
+      replay_t *replay = (replay_t *)bus->priv;
+      batch->time = replay->time[batch->reads[0].addr];
+   }
+   return 0;
+}
+
+
+static int replay_close(i2c_bus_t *bus)
+{
+   replay_t *replay = (replay_t *)bus->priv;
+   free(replay->data);
+   free(replay->recs);
+   free(replay->next);
+   free(replay);
+   return 0;
+}
+
+
+static const i2c_backend_t replay_backend =
+{
+   replay_write,
+   replay_write_reg,
+   replay_read,
+   replay_read_reg,
+   replay_read_block_reg,
+   replay_read_batch, /* batches are recorded as single reads */
+   replay_close
+};
+
+
+int i2c_replay_bus_open(i2c_bus_t *bus, const char *path)
+{
+   replay_t *replay = calloc(1, sizeof(replay_t));
+   if (replay == NULL)
+   {
+      return -ENOMEM;
+   }
+   int ret = load(replay, path);
+   if (ret < 0)
+   {
+      free(replay->data);
+      free(replay->recs);
+      free(replay->next);
+      free(replay);
+      return ret;
+   }
+   return i2c_bus_init(bus, &replay_backend, replay);
+}
+
@@ -0,0 +1,36 @@
+
+/*
+   I2C Trace Replay Interface
+
+   Feeds a recorded trace (see i2c_trace.h) back to unchanged drivers
+   without any delays. Records are matched per device address, so
+   interleaving between devices may differ from the recording.
+   Once the trace of a device is exhausted, its transactions fail with -ENODATA.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __I2C_REPLAY_H__
+#define __I2C_REPLAY_H__
+
+
+#include "i2c.h"
+
+
+/* opens a bus replaying the given trace file */
+int i2c_replay_bus_open(i2c_bus_t *bus, const char *path);
+
+
+#endif /* __I2C_REPLAY_H__ */
+
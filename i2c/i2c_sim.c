@@ -0,0 +1,892 @@
+
+/*
+   Simulated I2C Bus Implementation
+
+   Emulates the register maps of the sensor chips used by PenguAHRS,
+   so that the acquisition and fusion pipeline can run without hardware.
+   The simulated vehicle rests level, pointing north, at sea level;
+   all outputs carry deterministic pseudo-random noise.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2c_sim.h"
+#include "../util/interval.h"
+
+
+#define SIM_MAX_DEVS 8
+
+/* maximum number of samples generated to catch up with the current time: */
+#define SIM_MAX_CATCH_UP 128
+
+/* simulated environment: */
+#define SIM_TEMP   25.0f /* temperature in degrees celsius */
+#define SIM_MAG_N  0.2f  /* magnetic field north component in Ga */
+#define SIM_MAG_D  0.4f  /* magnetic field down component in Ga */
+#define SIM_ACC_D  -1.0f /* specific force down component at rest in g */
+
+
+typedef struct sim_dev sim_dev_t;
+struct sim_bus;
+
+struct sim_dev
+{
+   struct sim_bus *bus;
+   i2c_sim_chip_t chip;
+   uint8_t addr;
+   uint8_t regs[256];
+   uint8_t ptr; /* register address pointer */
+   uint32_t seed; /* noise generator state */
+   uint64_t next_sample; /* time of next output sample, 0 if unscheduled */
+   int oneshot; /* sample once, then go idle */
+   uint32_t samples; /* number of samples taken */
+
+   /* mpu6050 FIFO: */
+   uint8_t fifo[1024];
+   size_t fifo_len;
+
+   /* ms5611 conversion state: */
+   uint16_t prom[8];
+   uint8_t conv_cmd; /* pending conversion, 0 if none */
+   uint64_t conv_done; /* conversion completion time */
+
+   /* writes a fresh sample into the data registers: */
+   void (*sample)(sim_dev_t *dev);
+
+   /* output data period in ns, 0 if the chip does not sample on its own: */
+   uint64_t (*period)(sim_dev_t *dev);
+
+   /* register write, register read and command hooks: */
+   void (*write_reg)(sim_dev_t *dev, uint8_t reg, uint8_t val, uint64_t now);
+   int (*read_block)(sim_dev_t *dev, uint8_t reg, uint8_t *buf, size_t len, uint64_t now);
+   void (*command)(sim_dev_t *dev, uint8_t cmd, uint64_t now);
+};
+
+
+typedef struct sim_bus
+{
+   sim_dev_t devs[SIM_MAX_DEVS];
+   int n_devs;
+}
+sim_bus_t;
+
+
+static sim_dev_t *sim_find_dev(sim_bus_t *sim, uint8_t addr);
+
+
+
+/* helpers: */
+
+/* returns approximately normally distributed noise with unit variance */
+static float noise(sim_dev_t *dev)
+{
+   float sum = 0.0f;
+   int i;
+   for (i = 0; i < 4; i++)
+   {
+      dev->seed = dev->seed * 1103515245 + 12345;
+      sum += (float)((dev->seed >> 16) & 0x7FFF) / 32768.0f;
+   }
+   return (sum - 2.0f) * 1.7320508f;
+}
+
+
+static void put_be16(uint8_t *buf, int16_t val)
+{
+   buf[0] = (uint16_t)val >> 8;
+   buf[1] = (uint16_t)val & 0xFF;
+}
+
+
+static int16_t clamp16(float val)
+{
+   if (val > 32767.0f)
+   {
+      return 32767;
+   }
+   if (val < -32768.0f)
+   {
+      return -32768;
+   }
+   return (int16_t)val;
+}
+
+
+/* brings the data registers up to date */
+static void sim_update(sim_dev_t *dev, uint64_t now)
+{
+   if (dev->oneshot)
+   {
+      if (now >= dev->next_sample)
+      {
+         dev->sample(dev);
+         dev->oneshot = 0;
+         dev->next_sample = 0;
+      }
+      return;
+   }
+   uint64_t period = dev->period ? dev->period(dev) : 0;
+   if (period == 0)
+   {
+      dev->next_sample = 0;
+      return;
+   }
+   if (dev->next_sample == 0)
+   {
+      /* sampling has just been started: */
+      dev->sample(dev);
+      dev->next_sample = now + period;
+   }
+   else if (now >= dev->next_sample)
+   {
+      /* generate all samples since the last update, as a FIFO would see them: */
+      uint64_t missed = (now - dev->next_sample) / period + 1;
+      uint64_t i;
+      for (i = 0; i < missed && i < SIM_MAX_CATCH_UP; i++)
+      {
+         dev->sample(dev);
+      }
+      dev->next_sample += missed * period;
+   }
+}
+
+
+static int reg_read_block(sim_dev_t *dev, uint8_t reg, uint8_t *buf, size_t len, uint64_t now)
+{
+   sim_update(dev, now);
+   size_t i;
+   for (i = 0; i < len; i++)
+   {
+      buf[i] = dev->regs[(uint8_t)(reg + i)];
+   }
+   dev->ptr = reg + len;
+   return 0;
+}
+
+
+static void reg_write(sim_dev_t *dev, uint8_t reg, uint8_t val, uint64_t now)
+{
+   (void)now;
+   dev->regs[reg] = val;
+   /* restart sampling using the new configuration: */
+   dev->next_sample = 0;
+}
+
+
+/* returns 1 if the block [reg, reg + len) covers register r */
+static int covers(uint8_t reg, size_t len, uint8_t r)
+{
+   return r >= reg && r < reg + len;
+}
+
+
+
+/* ITG3200 emulation: */
+
+#define ITG3200_SMPLRT_DIV  0x15
+#define ITG3200_DLPF_FS     0x16
+#define ITG3200_INT_STATUS  0x1A
+#define ITG3200_TEMP_OUT_H  0x1B
+#define ITG3200_GYRO_XOUT_H 0x1D
+#define ITG3200_PWR_MGM     0x3E
+
+
+static void itg3200_reset(sim_dev_t *dev)
+{
+   memset(dev->regs, 0, sizeof(dev->regs));
+   dev->regs[0x00] = dev->addr; /* WHO_AM_I */
+}
+
+
+static uint64_t itg3200_period(sim_dev_t *dev)
+{
+   uint64_t base = (dev->regs[ITG3200_DLPF_FS] & 0x7) == 0 ? 125000 : 1000000;
+   return base * (dev->regs[ITG3200_SMPLRT_DIV] + 1);
+}
+
+
+static void itg3200_sample(sim_dev_t *dev)
+{
+   put_be16(&dev->regs[ITG3200_TEMP_OUT_H], clamp16((SIM_TEMP - 35.0f) * 280.0f - 13200.0f + noise(dev) * 10.0f));
+   /* 14.375 LSB per deg/s, vehicle at rest, with a zero-rate offset: */
+   static const float bias[3] = {5.0f, -3.0f, 2.0f};
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      put_be16(&dev->regs[ITG3200_GYRO_XOUT_H + 2 * i], clamp16(bias[i] + noise(dev) * 2.0f));
+   }
+   dev->regs[ITG3200_INT_STATUS] |= 0x05; /* RAW_DATA_RDY, ITG_RDY */
+}
+
+
+static void itg3200_write_reg(sim_dev_t *dev, uint8_t reg, uint8_t val, uint64_t now)
+{
+   if (reg == ITG3200_PWR_MGM && (val & 0x80))
+   {
+      itg3200_reset(dev);
+      dev->next_sample = 0;
+      return;
+   }
+   reg_write(dev, reg, val, now);
+}
+
+
+static int itg3200_read_block(sim_dev_t *dev, uint8_t reg, uint8_t *buf, size_t len, uint64_t now)
+{
+   reg_read_block(dev, reg, buf, len, now);
+   if (covers(reg, len, ITG3200_INT_STATUS))
+   {
+      dev->regs[ITG3200_INT_STATUS] = 0;
+   }
+   return 0;
+}
+
+
+
+/* BMA180 emulation: */
+
+#define BMA180_ACC_X_LSB   0x02
+#define BMA180_TEMP        0x08
+#define BMA180_RESET       0x10
+#define BMA180_BW_TCS      0x20
+#define BMA180_GAIN_T      0x31
+#define BMA180_OFFSET_LSB1 0x35
+
+
+static const float bma180_range_tab[8] = {1.0f, 1.5f, 2.0f, 3.0f, 4.0f, 8.0f, 16.0f, 16.0f};
+static const uint32_t bma180_bw_tab[16] = {10, 20, 40, 75, 150, 300, 600, 1200,
+                                           1200, 1200, 1200, 1200, 1200, 1200, 1200, 1200};
+
+
+static void bma180_reset(sim_dev_t *dev)
+{
+   memset(dev->regs, 0, sizeof(dev->regs));
+   dev->regs[0x00] = 0x03; /* chip id */
+   dev->regs[0x01] = 0x14; /* version */
+   dev->regs[BMA180_BW_TCS] = 0x40; /* 150Hz */
+   dev->regs[BMA180_OFFSET_LSB1] = 0x04; /* 2G */
+   int i;
+   for (i = 0; i < 4; i++)
+   {
+      dev->regs[BMA180_GAIN_T + i] = 0x80;
+   }
+   for (i = 1; i < 6; i++)
+   {
+      dev->regs[BMA180_OFFSET_LSB1 + i] = 0x80;
+   }
+}
+
+
+static uint64_t bma180_period(sim_dev_t *dev)
+{
+   /* new data is flagged at twice the filter bandwidth: */
+   return 500000000 / bma180_bw_tab[dev->regs[BMA180_BW_TCS] >> 4];
+}
+
+
+static void bma180_sample(sim_dev_t *dev)
+{
+   float range = bma180_range_tab[(dev->regs[BMA180_OFFSET_LSB1] >> 1) & 0x7];
+   float g[3] = {0.0f, 0.0f, SIM_ACC_D};
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      /* 14 bit, left-aligned, new_data flag in bit 0 of the LSB: */
+      float counts = (g[i] + noise(dev) * 0.005f) * 8192.0f / range;
+      if (counts > 8191.0f)
+      {
+         counts = 8191.0f;
+      }
+      else if (counts < -8192.0f)
+      {
+         counts = -8192.0f;
+      }
+      uint16_t val = (uint16_t)((int16_t)counts << 2);
+      dev->regs[BMA180_ACC_X_LSB + 2 * i] = (val & 0xFC) | 0x01;
+      dev->regs[BMA180_ACC_X_LSB + 2 * i + 1] = val >> 8;
+   }
+   dev->regs[BMA180_TEMP] = (uint8_t)(int8_t)((SIM_TEMP - 24.0f) * 2.0f);
+}
+
+
+static void bma180_write_reg(sim_dev_t *dev, uint8_t reg, uint8_t val, uint64_t now)
+{
+   if (reg == BMA180_RESET && val == 0xB6)
+   {
+      bma180_reset(dev);
+      dev->next_sample = 0;
+      return;
+   }
+   reg_write(dev, reg, val, now);
+}
+
+
+static int bma180_read_block(sim_dev_t *dev, uint8_t reg, uint8_t *buf, size_t len, uint64_t now)
+{
+   reg_read_block(dev, reg, buf, len, now);
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      uint8_t lsb = BMA180_ACC_X_LSB + 2 * i;
+      if (covers(reg, len, lsb))
+      {
+         dev->regs[lsb] &= ~0x01;
+      }
+   }
+   return 0;
+}
+
+
+
+/* HMC5883 emulation: */
+
+#define HMC5883_CFG_A  0x00
+#define HMC5883_CFG_B  0x01
+#define HMC5883_CFG_MR 0x02
+#define HMC5883_MAGX_H 0x03
+#define HMC5883_STATUS 0x09
+
+
+static const float hmc5883_odr_tab[8] = {0.5f, 1.0f, 2.0f, 5.0f, 10.0f, 20.0f, 50.0f, 50.0f};
+static const float hmc5883_gain_tab[8] = {1602.0f, 1300.0f, 970.0f, 780.0f, 530.0f, 460.0f, 390.0f, 280.0f};
+
+
+static void hmc5883_reset(sim_dev_t *dev)
+{
+   memset(dev->regs, 0, sizeof(dev->regs));
+   dev->regs[HMC5883_CFG_A] = 0x10;
+   dev->regs[HMC5883_CFG_B] = 0x20;
+   dev->regs[HMC5883_CFG_MR] = 0x01;
+   dev->regs[0x0A] = 'H';
+   dev->regs[0x0B] = '4';
+   dev->regs[0x0C] = '3';
+}
+
+
+static uint64_t hmc5883_period(sim_dev_t *dev)
+{
+   if ((dev->regs[HMC5883_CFG_MR] & 0x3) != 0)
+   {
+      return 0;
+   }
+   return (uint64_t)(1.0e9f / hmc5883_odr_tab[(dev->regs[HMC5883_CFG_A] >> 2) & 0x7]);
+}
+
+
+static void hmc5883_sample(sim_dev_t *dev)
+{
+   float gain = hmc5883_gain_tab[dev->regs[HMC5883_CFG_B] >> 5];
+   /* output order is x, z, y: */
+   float field[3] = {SIM_MAG_N, SIM_MAG_D, 0.0f};
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      put_be16(&dev->regs[HMC5883_MAGX_H + 2 * i], clamp16((field[i] + noise(dev) * 0.002f) * gain));
+   }
+   dev->regs[HMC5883_STATUS] |= 0x01; /* RDY, not cleared by reading */
+}
+
+
+static void hmc5883_write_reg(sim_dev_t *dev, uint8_t reg, uint8_t val, uint64_t now)
+{
+   reg_write(dev, reg, val, now);
+   if (reg == HMC5883_CFG_MR)
+   {
+      dev->next_sample = 0;
+      if ((val & 0x3) == 0x01)
+      {
+         /* single measurement takes about 6ms, device idles afterwards: */
+         dev->regs[HMC5883_CFG_MR] = 0x02;
+         dev->oneshot = 1;
+         dev->next_sample = now + 6000000;
+      }
+   }
+}
+
+
+/* MS5611 emulation: */
+
+#define MS5611_ADC   0x00
+#define MS5611_RESET 0x1E
+
+/* conversion times in us, indexed by oversampling rate: */
+static const uint32_t ms5611_conv_us[5] = {600, 1170, 2280, 4540, 9040};
+
+
+/* same algorithm as the driver, see MS5611 application note AN520 */
+static uint16_t ms5611_crc4(uint16_t *n_prom)
+{
+   uint16_t n_rem = 0;
+   uint16_t crc_read = n_prom[7];
+   n_prom[7] = (0xFF00 & (n_prom[7]));
+   int cnt;
+   for (cnt = 0; cnt < 16; cnt++)
+   {
+      if (cnt % 2 == 1)
+      {
+         n_rem ^= (n_prom[cnt >> 1]) & 0x00FF;
+      }
+      else
+      {
+         n_rem ^= n_prom[cnt >> 1] >> 8;
+      }
+      int n_bit;
+      for (n_bit = 8; n_bit > 0; n_bit--)
+      {
+         if (n_rem & (0x8000))
+         {
+            n_rem = (n_rem << 1) ^ 0x3000;
+         }
+         else
+         {
+            n_rem = (n_rem << 1);
+         }
+      }
+   }
+   n_rem = (n_rem >> 12) & 0xF;
+   n_prom[7] = crc_read;
+   return n_rem;
+}
+
+
+static void ms5611_reset(sim_dev_t *dev)
+{
+   /* calibration coefficients from the data sheet example: */
+   static const uint16_t c[8] = {0x0000, 40127, 36924, 23317, 23282, 33464, 28312, 0x0000};
+   memcpy(dev->prom, c, sizeof(dev->prom));
+   dev->prom[7] |= ms5611_crc4(dev->prom);
+   dev->conv_cmd = 0;
+}
+
+
+static void ms5611_command(sim_dev_t *dev, uint8_t cmd, uint64_t now)
+{
+   if (cmd == MS5611_RESET)
+   {
+      ms5611_reset(dev);
+   }
+   else if ((cmd & 0xE1) == 0x40 && ((cmd >> 1) & 0x7) < 5)
+   {
+      /* D1 (0x40) or D2 (0x50) conversion: */
+      dev->conv_cmd = cmd;
+      dev->conv_done = now + 1000 * (uint64_t)ms5611_conv_us[(cmd >> 1) & 0x7];
+   }
+}
+
+
+static int ms5611_read_block(sim_dev_t *dev, uint8_t reg, uint8_t *buf, size_t len, uint64_t now)
+{
+   memset(buf, 0, len);
+   if (reg == MS5611_ADC && len == 3)
+   {
+      /* reading before the conversion has finished yields 0: */
+      if (dev->conv_cmd && now >= dev->conv_done)
+      {
+         uint32_t val;
+         if (dev->conv_cmd & 0x10)
+         {
+            val = 8569150 + (int32_t)(noise(dev) * 5.0f); /* D2: 20.07 degrees celsius */
+         }
+         else
+         {
+            val = 9085466 + (int32_t)(noise(dev) * 30.0f); /* D1: 1000.09 mbar */
+         }
+         buf[0] = val >> 16;
+         buf[1] = val >> 8;
+         buf[2] = val;
+      }
+      dev->conv_cmd = 0;
+      return 0;
+   }
+   if ((reg & 0xF1) == 0xA0 && len == 2)
+   {
+      uint16_t val = dev->prom[(reg >> 1) & 0x7];
+      buf[0] = val >> 8;
+      buf[1] = val & 0xFF;
+      return 0;
+   }
+   return -EIO;
+}
+
+
+
+/* MPU6050 emulation: */
+
+#define MPU6050_SMPLRT_DIV    0x19
+#define MPU6050_CONFIG        0x1A
+#define MPU6050_GYRO_CONFIG   0x1B
+#define MPU6050_ACCEL_CONFIG  0x1C
+#define MPU6050_FIFO_EN       0x23
+#define MPU6050_I2C_SLV0_ADDR 0x25
+#define MPU6050_I2C_SLV4_CTRL 0x34
+#define MPU6050_INT_STATUS    0x3A
+#define MPU6050_ACCEL_XOUT_H  0x3B
+#define MPU6050_TEMP_OUT_H    0x41
+#define MPU6050_GYRO_XOUT_H   0x43
+#define MPU6050_EXT_SENS_DATA 0x49
+#define MPU6050_I2C_MST_DELAY 0x67
+#define MPU6050_USER_CTRL     0x6A
+#define MPU6050_PWR_MGMT_1    0x6B
+#define MPU6050_FIFO_COUNTH   0x72
+#define MPU6050_FIFO_R_W      0x74
+#define MPU6050_WHO_AM_I      0x75
+
+
+static void mpu6050_reset(sim_dev_t *dev)
+{
+   memset(dev->regs, 0, sizeof(dev->regs));
+   dev->regs[MPU6050_PWR_MGMT_1] = 0x40; /* sleep */
+   dev->regs[MPU6050_WHO_AM_I] = 0x68; /* AD0 is not reflected */
+   dev->fifo_len = 0;
+}
+
+
+static void mpu6050_fifo_push(sim_dev_t *dev, uint8_t *data, size_t len)
+{
+   if (dev->fifo_len + len > sizeof(dev->fifo))
+   {
+      /* overflow, the oldest bytes are discarded: */
+      size_t drop = dev->fifo_len + len - sizeof(dev->fifo);
+      memmove(dev->fifo, dev->fifo + drop, dev->fifo_len - drop);
+      dev->fifo_len -= drop;
+      dev->regs[MPU6050_INT_STATUS] |= 0x10; /* FIFO_OFLOW */
+   }
+   memcpy(dev->fifo + dev->fifo_len, data, len);
+   dev->fifo_len += len;
+}
+
+
+static uint64_t mpu6050_period(sim_dev_t *dev)
+{
+   if (dev->regs[MPU6050_PWR_MGMT_1] & 0x40)
+   {
+      return 0; /* sleeping */
+   }
+   uint8_t dlpf = dev->regs[MPU6050_CONFIG] & 0x7;
+   uint64_t base = (dlpf == 0 || dlpf == 7) ? 125000 : 1000000;
+   return base * (dev->regs[MPU6050_SMPLRT_DIV] + 1);
+}
+
+
+/* auxiliary I2C master: the slaves are devices on the simulated bus itself */
+static void mpu6050_aux_sample(sim_dev_t *dev)
+{
+   uint8_t dly = dev->regs[MPU6050_I2C_SLV4_CTRL] & 0x1F;
+   uint8_t ext = MPU6050_EXT_SENS_DATA;
+   int i;
+   for (i = 0; i < 4; i++)
+   {
+      uint8_t *slv = &dev->regs[MPU6050_I2C_SLV0_ADDR + 3 * i];
+      uint8_t len = slv[2] & 0x0F;
+      if (!(slv[2] & 0x80) || !(slv[0] & 0x80))
+      {
+         continue; /* disabled or write access */
+      }
+      int skip = (dev->regs[MPU6050_I2C_MST_DELAY] & (1 << i)) && (dev->samples % (dly + 1)) != 0;
+      sim_dev_t *aux = sim_find_dev(dev->bus, slv[0] & 0x7F);
+      if (!skip && aux != NULL && aux != dev && ext + len <= MPU6050_EXT_SENS_DATA + 24)
+      {
+         aux->read_block(aux, slv[1], &dev->regs[ext], len, monotonic_ns());
+      }
+      ext += len;
+   }
+}
+
+
+static void mpu6050_sample(sim_dev_t *dev)
+{
+   float acc_lsb = (float)(16384 >> ((dev->regs[MPU6050_ACCEL_CONFIG] >> 3) & 0x3));
+   float gyro_lsb = 32768.0f / (float)(250 << ((dev->regs[MPU6050_GYRO_CONFIG] >> 3) & 0x3));
+   float g[3] = {0.0f, 0.0f, SIM_ACC_D};
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      put_be16(&dev->regs[MPU6050_ACCEL_XOUT_H + 2 * i], clamp16((g[i] + noise(dev) * 0.004f) * acc_lsb));
+      put_be16(&dev->regs[MPU6050_GYRO_XOUT_H + 2 * i], clamp16(noise(dev) * 0.05f * gyro_lsb));
+   }
+   put_be16(&dev->regs[MPU6050_TEMP_OUT_H], clamp16((SIM_TEMP - 36.53f) * 340.0f));
+   dev->regs[MPU6050_INT_STATUS] |= 0x01; /* DATA_RDY */
+   if (dev->regs[MPU6050_USER_CTRL] & 0x20)
+   {
+      mpu6050_aux_sample(dev);
+   }
+   dev->samples++;
+
+   if (dev->regs[MPU6050_USER_CTRL] & 0x40)
+   {
+      /* FIFO_EN bits select the registers pushed per sample, in register order: */
+      uint8_t en = dev->regs[MPU6050_FIFO_EN];
+      if (en & 0x08)
+      {
+         mpu6050_fifo_push(dev, &dev->regs[MPU6050_ACCEL_XOUT_H], 6);
+      }
+      if (en & 0x80)
+      {
+         mpu6050_fifo_push(dev, &dev->regs[MPU6050_TEMP_OUT_H], 2);
+      }
+      for (i = 0; i < 3; i++)
+      {
+         if (en & (0x40 >> i))
+         {
+            mpu6050_fifo_push(dev, &dev->regs[MPU6050_GYRO_XOUT_H + 2 * i], 2);
+         }
+      }
+   }
+}
+
+
+static void mpu6050_write_reg(sim_dev_t *dev, uint8_t reg, uint8_t val, uint64_t now)
+{
+   if (reg == MPU6050_PWR_MGMT_1 && (val & 0x80))
+   {
+      mpu6050_reset(dev);
+      dev->next_sample = 0;
+      return;
+   }
+   if (reg == MPU6050_WHO_AM_I)
+   {
+      return; /* read-only */
+   }
+   if (reg == MPU6050_USER_CTRL && (val & 0x04))
+   {
+      dev->fifo_len = 0; /* FIFO_RESET, clears itself */
+      val &= ~0x04;
+   }
+   reg_write(dev, reg, val, now);
+}
+
+
+static int mpu6050_read_block(sim_dev_t *dev, uint8_t reg, uint8_t *buf, size_t len, uint64_t now)
+{
+   sim_update(dev, now);
+   if (reg == MPU6050_FIFO_R_W)
+   {
+      /* FIFO reads do not increment the register address: */
+      size_t n = len < dev->fifo_len ? len : dev->fifo_len;
+      memcpy(buf, dev->fifo, n);
+      memset(buf + n, 0xFF, len - n);
+      memmove(dev->fifo, dev->fifo + n, dev->fifo_len - n);
+      dev->fifo_len -= n;
+      return 0;
+   }
+   put_be16(&dev->regs[MPU6050_FIFO_COUNTH], dev->fifo_len);
+   reg_read_block(dev, reg, buf, len, now);
+   if (covers(reg, len, MPU6050_INT_STATUS))
+   {
+      dev->regs[MPU6050_INT_STATUS] = 0;
+   }
+   return 0;
+}
+
+
+
+/* bus backend: */
+
+static sim_dev_t *sim_find_dev(sim_bus_t *sim, uint8_t addr)
+{
+   int i;
+   for (i = 0; i < sim->n_devs; i++)
+   {
+      if (sim->devs[i].addr == addr)
+      {
+         return &sim->devs[i];
+      }
+   }
+   return NULL;
+}
+
+
+static sim_dev_t *sim_find(i2c_bus_t *bus, uint8_t addr)
+{
+   return sim_find_dev((sim_bus_t *)bus->priv, addr);
+}
+
+
+static int sim_read_block_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len)
+{
+   sim_dev_t *dev = sim_find(bus, addr);
+   if (dev == NULL)
+   {
+      return -ENXIO;
+   }
+   return dev->read_block(dev, reg, buf, len, monotonic_ns());
+}
+
+
+static int sim_write(i2c_bus_t *bus, uint8_t addr, uint8_t val)
+{
+   sim_dev_t *dev = sim_find(bus, addr);
+   if (dev == NULL)
+   {
+      return -ENXIO;
+   }
+   if (dev->command)
+   {
+      dev->command(dev, val, monotonic_ns());
+   }
+   else
+   {
+      dev->ptr = val;
+   }
+   return 0;
+}
+
+
+static int sim_write_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg, uint8_t val)
+{
+   sim_dev_t *dev = sim_find(bus, addr);
+   if (dev == NULL)
+   {
+      return -ENXIO;
+   }
+   dev->write_reg(dev, reg, val, monotonic_ns());
+   return 0;
+}
+
+
+static int sim_read(i2c_bus_t *bus, uint8_t addr)
+{
+   sim_dev_t *dev = sim_find(bus, addr);
+   if (dev == NULL)
+   {
+      return -ENXIO;
+   }
+   uint8_t val;
+   int ret = dev->read_block(dev, dev->ptr, &val, 1, monotonic_ns());
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return val;
+}
+
+
+static int sim_read_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg)
+{
+   uint8_t val;
+   int ret = sim_read_block_reg(bus, addr, reg, &val, 1);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   return val;
+}
+
+
+static int sim_close(i2c_bus_t *bus)
+{
+   free(bus->priv);
+   return 0;
+}
+
+
+static const i2c_backend_t sim_backend =
+{
+   sim_write,
+   sim_write_reg,
+   sim_read,
+   sim_read_reg,
+   sim_read_block_reg,
+   NULL,
+   sim_close
+};
+
+
+int i2c_sim_bus_open(i2c_bus_t *bus)
+{
+   sim_bus_t *sim = calloc(1, sizeof(sim_bus_t));
+   if (sim == NULL)
+   {
+      return -ENOMEM;
+   }
+   return i2c_bus_init(bus, &sim_backend, sim);
+}
+
+
+int i2c_sim_attach(i2c_bus_t *bus, i2c_sim_chip_t chip)
+{
+   static const uint8_t addrs[] = {0x69, 0x40, 0x1E, 0x77, 0x69};
+   sim_bus_t *sim = (sim_bus_t *)bus->priv;
+   int ret = 0;
+
+   pthread_mutex_lock(&bus->mutex);
+   if (sim->n_devs == SIM_MAX_DEVS)
+   {
+      ret = -ENOMEM;
+      goto out;
+   }
+   if (sim_find(bus, addrs[chip]) != NULL)
+   {
+      ret = -EBUSY;
+      goto out;
+   }
+
+   sim_dev_t *dev = &sim->devs[sim->n_devs++];
+   memset(dev, 0, sizeof(sim_dev_t));
+   dev->bus = sim;
+   dev->chip = chip;
+   dev->addr = addrs[chip];
+   dev->seed = 0x5EED + chip;
+   dev->write_reg = reg_write;
+   dev->read_block = reg_read_block;
+
+   switch (chip)
+   {
+      case I2C_SIM_ITG3200:
+         itg3200_reset(dev);
+         dev->sample = itg3200_sample;
+         dev->period = itg3200_period;
+         dev->write_reg = itg3200_write_reg;
+         dev->read_block = itg3200_read_block;
+         break;
+
+      case I2C_SIM_BMA180:
+         bma180_reset(dev);
+         dev->sample = bma180_sample;
+         dev->period = bma180_period;
+         dev->write_reg = bma180_write_reg;
+         dev->read_block = bma180_read_block;
+         break;
+
+      case I2C_SIM_HMC5883:
+         hmc5883_reset(dev);
+         dev->sample = hmc5883_sample;
+         dev->period = hmc5883_period;
+         dev->write_reg = hmc5883_write_reg;
+         break;
+
+      case I2C_SIM_MS5611:
+         ms5611_reset(dev);
+         dev->command = ms5611_command;
+         dev->read_block = ms5611_read_block;
+         break;
+
+      case I2C_SIM_MPU6050:
+         mpu6050_reset(dev);
+         dev->sample = mpu6050_sample;
+         dev->period = mpu6050_period;
+         dev->write_reg = mpu6050_write_reg;
+         dev->read_block = mpu6050_read_block;
+         break;
+   }
+
+out:
+   pthread_mutex_unlock(&bus->mutex);
+   return ret;
+}
+
@@ -0,0 +1,48 @@
+
+/*
+   Simulated I2C Bus Interface
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __I2C_SIM_H__
+#define __I2C_SIM_H__
+
+
+#include "i2c.h"
+
+
+/* emulated chips: */
+typedef enum
+{
+   I2C_SIM_ITG3200,
+   I2C_SIM_BMA180,
+   I2C_SIM_HMC5883,
+   I2C_SIM_MS5611,
+   I2C_SIM_MPU6050
+}
+i2c_sim_chip_t;
+
+
+/* opens a simulated bus without any devices attached */
+int i2c_sim_bus_open(i2c_bus_t *bus);
+
+/* attaches an emulated chip to a simulated bus,
+   returns -EBUSY if its address is already in use;
+   the MPU6050 auxiliary master reaches all other chips on the bus */
+int i2c_sim_attach(i2c_bus_t *bus, i2c_sim_chip_t chip);
+
+
+#endif /* __I2C_SIM_H__ */
+
@@ -0,0 +1,182 @@
+
+/*
+   I2C Transaction Statistics Implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <inttypes.h>
+
+#include "i2c_stats.h"
+
+
+#define SUB_COUNT (1 << I2C_HIST_SUB_BITS)
+
+
+/* bucket index: values below SUB_COUNT map linearly,
+   above that, the exponent selects a group of SUB_COUNT buckets
+   and the bits below the leading one select the bucket within: */
+static int hist_bucket(uint64_t val)
+{
+   if (val < SUB_COUNT)
+   {
+      return (int)val;
+   }
+   int exp = 63 - __builtin_clzll(val);
+   int bucket = ((exp - I2C_HIST_SUB_BITS + 1) << I2C_HIST_SUB_BITS)
+              + (int)((val >> (exp - I2C_HIST_SUB_BITS)) & (SUB_COUNT - 1));
+   return bucket < I2C_HIST_BUCKETS ? bucket : I2C_HIST_BUCKETS - 1;
+}
+
+
+/* largest value falling into a bucket: */
+static uint64_t hist_bucket_limit(int bucket)
+{
+   if (bucket < SUB_COUNT)
+   {
+      return bucket;
+   }
+   int exp = (bucket >> I2C_HIST_SUB_BITS) + I2C_HIST_SUB_BITS - 1;
+   uint64_t sub = bucket & (SUB_COUNT - 1);
+   return ((SUB_COUNT + sub + 1) << (exp - I2C_HIST_SUB_BITS)) - 1;
+}
+
+
+static void hist_add(i2c_hist_t *hist, uint64_t val)
+{
+   hist->count++;
+   hist->sum += val;
+   if (val > hist->max)
+   {
+      hist->max = val;
+   }
+   hist->buckets[hist_bucket(val)]++;
+}
+
+
+uint64_t i2c_hist_quantile(const i2c_hist_t *hist, double p)
+{
+   if (hist->count == 0)
+   {
+      return 0;
+   }
+   uint64_t rank = (uint64_t)(p * (double)hist->count);
+   if (rank >= hist->count)
+   {
+      rank = hist->count - 1;
+   }
+   uint64_t seen = 0;
+   int i;
+   for (i = 0; i < I2C_HIST_BUCKETS; i++)
+   {
+      seen += hist->buckets[i];
+      if (seen > rank)
+      {
+         uint64_t limit = hist_bucket_limit(i);
+         return limit < hist->max ? limit : hist->max;
+      }
+   }
+   return hist->max;
+}
+
+
+/* open addressing with linear probing, entries are never removed: */
+static i2c_stats_entry_t *lookup(i2c_stats_t *stats, int write, uint8_t addr, uint8_t reg)
+{
+   unsigned int key = (write ? 0x10000 : 0) | (addr << 8) | reg;
+   unsigned int pos = (key * 2654435761U) >> 26; /* 6 bit hash */
+   int i;
+   for (i = 0; i < I2C_STATS_ENTRIES; i++)
+   {
+      i2c_stats_entry_t *entry = &stats->entries[(pos + i) % I2C_STATS_ENTRIES];
+      if (!entry->used)
+      {
+         entry->used = 1;
+         entry->write = write;
+         entry->addr = addr;
+         entry->reg = reg;
+         return entry;
+      }
+      if (entry->write == write && entry->addr == addr && entry->reg == reg)
+      {
+         return entry;
+      }
+   }
+   return NULL;
+}
+
+
+void i2c_stats_record(i2c_stats_t *stats, int write, uint8_t addr, uint8_t reg,
+                      size_t bytes, int ret, uint64_t lock_wait, uint64_t xfer_time)
+{
+   i2c_stats_entry_t *entry = lookup(stats, write, addr, reg);
+   if (entry == NULL)
+   {
+      stats->untracked++;
+      return;
+   }
+
+   /* combined transfers address each message directly: */
+   if (addr != I2C_STATS_BATCH && addr != stats->last_addr)
+   {
+      stats->last_addr = addr;
+      stats->addr_switches++;
+      entry->addr_switches++;
+   }
+
+   entry->transactions++;
+   if (ret < 0)
+   {
+      entry->errors++;
+   }
+   else
+   {
+      entry->bytes += bytes;
+   }
+   hist_add(&entry->xfer_time, xfer_time);
+   hist_add(&entry->lock_wait, lock_wait);
+}
+
+
+void i2c_stats_dump(const i2c_stats_t *stats, FILE *file)
+{
+   fprintf(file, "addr reg  dir  count      errors  bytes       switches   "
+                 "xfer mean/p50/p99/max [us]        lock mean/p99/max [us]\n");
+   int i;
+   for (i = 0; i < I2C_STATS_ENTRIES; i++)
+   {
+      const i2c_stats_entry_t *entry = &stats->entries[i];
+      if (!entry->used)
+      {
+         continue;
+      }
+      const i2c_hist_t *xfer = &entry->xfer_time;
+      const i2c_hist_t *lock = &entry->lock_wait;
+      fprintf(file, "0x%02X 0x%02X %-4s %-10" PRIu64 " %-7" PRIu64 " %-11" PRIu64 " %-10" PRIu64
+                    " %8.1f %8.1f %8.1f %8.1f   %8.1f %8.1f %8.1f\n",
+              entry->addr, entry->reg,
+              entry->addr == I2C_STATS_BATCH ? "bat" : (entry->write ? "wr" : "rd"),
+              entry->transactions, entry->errors, entry->bytes, entry->addr_switches,
+              xfer->count ? xfer->sum / xfer->count / 1000.0 : 0.0,
+              i2c_hist_quantile(xfer, 0.5) / 1000.0,
+              i2c_hist_quantile(xfer, 0.99) / 1000.0,
+              xfer->max / 1000.0,
+              lock->count ? lock->sum / lock->count / 1000.0 : 0.0,
+              i2c_hist_quantile(lock, 0.99) / 1000.0,
+              lock->max / 1000.0);
+   }
+   fprintf(file, "address switches: %" PRIu64 ", untracked transactions: %" PRIu64 "\n",
+           stats->addr_switches, stats->untracked);
+}
+
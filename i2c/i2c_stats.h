@@ -0,0 +1,99 @@
+
+/*
+   I2C Transaction Statistics Interface
+
+   Always-on counters and log-linear latency histograms,
+   kept per bus and (device address, register, direction).
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __I2C_STATS_H__
+#define __I2C_STATS_H__
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+
+/* number of (addr, reg, direction) entries tracked per bus: */
+#define I2C_STATS_ENTRIES 64
+
+/* histogram resolution: 2 ^ SUB_BITS buckets per power of two,
+   covering 0ns ... 2 ^ 35ns (about 34s): */
+#define I2C_HIST_SUB_BITS 3
+#define I2C_HIST_BUCKETS ((36 - I2C_HIST_SUB_BITS) << I2C_HIST_SUB_BITS)
+
+/* pseudo address for combined transfers, reg holds the number of reads: */
+#define I2C_STATS_BATCH 0x80
+
+/* pseudo register for transfers without register address: */
+#define I2C_STATS_NO_REG 0xFF
+
+
+/* latency histogram, values in ns: */
+typedef struct
+{
+   uint64_t count;
+   uint64_t sum;
+   uint64_t max;
+   uint32_t buckets[I2C_HIST_BUCKETS];
+}
+i2c_hist_t;
+
+
+typedef struct
+{
+   /* key: */
+   uint8_t used;
+   uint8_t write;
+   uint8_t addr;
+   uint8_t reg;
+
+   /* counters: */
+   uint64_t transactions;
+   uint64_t bytes;
+   uint64_t errors;
+   uint64_t addr_switches; /* slave address changes to reach this entry */
+
+   i2c_hist_t xfer_time; /* time spent in the transaction */
+   i2c_hist_t lock_wait; /* time spent waiting for the bus lock */
+}
+i2c_stats_entry_t;
+
+
+typedef struct i2c_stats
+{
+   uint8_t last_addr;
+   uint64_t addr_switches;
+   uint64_t untracked; /* transactions missed because the table was full */
+   i2c_stats_entry_t entries[I2C_STATS_ENTRIES];
+}
+i2c_stats_t;
+
+
+/* records a transaction; the caller serializes access (bus lock) */
+void i2c_stats_record(i2c_stats_t *stats, int write, uint8_t addr, uint8_t reg,
+                      size_t bytes, int ret, uint64_t lock_wait, uint64_t xfer_time);
+
+/* returns an upper bound of the p-quantile (0.0 ... 1.0) of a histogram in ns */
+uint64_t i2c_hist_quantile(const i2c_hist_t *hist, double p);
+
+/* prints one line per entry */
+void i2c_stats_dump(const i2c_stats_t *stats, FILE *file);
+
+
+#endif /* __I2C_STATS_H__ */
+
@@ -0,0 +1,54 @@
+
+/*
+   I2C Trace Recording Implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <errno.h>
+
+#include "i2c_trace.h"
+
+
+FILE *i2c_trace_create(const char *path)
+{
+   FILE *file = fopen(path, "wb");
+   if (file == NULL)
+   {
+      return NULL;
+   }
+   uint32_t version = I2C_TRACE_VERSION;
+   if (fwrite("I2CT", 4, 1, file) != 1 || fwrite(&version, sizeof(version), 1, file) != 1)
+   {
+      fclose(file);
+      return NULL;
+   }
+   return file;
+}
+
+
+void i2c_trace_write(FILE *file, uint64_t time, i2c_trace_op_t op, uint8_t addr, uint8_t reg,
+                     int status, const uint8_t *payload, size_t len)
+{
+   i2c_trace_rec_t rec;
+   rec.time = time;
+   rec.op = op;
+   rec.addr = addr;
+   rec.reg = reg;
+   rec.status = status < 0 ? (status < -128 ? -EIO : status) : 0;
+   rec.len = status < 0 ? 0 : len;
+   fwrite(&rec, sizeof(rec), 1, file);
+   fwrite(payload, 1, rec.len, file);
+}
+
@@ -0,0 +1,69 @@
+
+/*
+   I2C Trace Recording and Replay Interface
+
+   A trace is a file starting with the 4 byte magic "I2CT" and a
+   uint32_t version, followed by one record per transaction:
+   a packed i2c_trace_rec_t header and len payload bytes.
+   All fields are stored in host byte order.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __I2C_TRACE_H__
+#define __I2C_TRACE_H__
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define I2C_TRACE_VERSION 2
+
+
+/* transaction types, mapping to the i2c_* functions: */
+typedef enum
+{
+   I2C_TRACE_WRITE,
+   I2C_TRACE_WRITE_REG,
+   I2C_TRACE_READ,
+   I2C_TRACE_READ_REG,
+   I2C_TRACE_READ_BLOCK_REG
+}
+i2c_trace_op_t;
+
+
+typedef struct __attribute__((packed))
+{
+   uint64_t time; /* completion of the transaction, monotonic_raw_ns() */
+   uint8_t op;
+   uint8_t addr;
+   uint8_t reg;
+   int8_t status; /* 0 or negative errno */
+   uint16_t len; /* payload: written or read data, empty on error */
+}
+i2c_trace_rec_t;
+
+
+/* creates a trace file and writes its header */
+FILE *i2c_trace_create(const char *path);
+
+/* appends a record */
+void i2c_trace_write(FILE *file, uint64_t time, i2c_trace_op_t op, uint8_t addr, uint8_t reg,
+                     int status, const uint8_t *payload, size_t len);
+
+
+#endif /* __I2C_TRACE_H__ */
+
@@ -0,0 +1,349 @@
+
+/*
+   I2C Bus Worker Implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "i2c_worker.h"
+
+
+#define QUEUE_MASK (I2C_QUEUE_SIZE - 1)
+
+
+
+/* lock-free queue, see D. Vyukov's bounded MPMC queue: */
+
+static void queue_init(i2c_queue_t *queue)
+{
+   size_t i;
+   for (i = 0; i < I2C_QUEUE_SIZE; i++)
+   {
+      queue->cells[i].seq = i;
+      queue->cells[i].req = NULL;
+   }
+   queue->head = 0;
+   queue->tail = 0;
+}
+
+
+static int queue_put(i2c_queue_t *queue, i2c_req_t *req)
+{
+   size_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+   while (1)
+   {
+      size_t seq = __atomic_load_n(&queue->cells[pos & QUEUE_MASK].seq, __ATOMIC_ACQUIRE);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0)
+      {
+         /* cell is free, try to claim it: */
+         if (__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+         {
+            break;
+         }
+      }
+      else if (diff < 0)
+      {
+         return -EAGAIN; /* full */
+      }
+      else
+      {
+         pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+      }
+   }
+   queue->cells[pos & QUEUE_MASK].req = req;
+   __atomic_store_n(&queue->cells[pos & QUEUE_MASK].seq, pos + 1, __ATOMIC_RELEASE);
+   return 0;
+}
+
+
+static i2c_req_t *queue_get(i2c_queue_t *queue)
+{
+   size_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+   while (1)
+   {
+      size_t seq = __atomic_load_n(&queue->cells[pos & QUEUE_MASK].seq, __ATOMIC_ACQUIRE);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0)
+      {
+         /* cell is filled, try to take it: */
+         if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+         {
+            break;
+         }
+      }
+      else if (diff < 0)
+      {
+         return NULL; /* empty */
+      }
+      else
+      {
+         pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+      }
+   }
+   i2c_req_t *req = queue->cells[pos & QUEUE_MASK].req;
+   __atomic_store_n(&queue->cells[pos & QUEUE_MASK].seq, pos + I2C_QUEUE_SIZE, __ATOMIC_RELEASE);
+   return req;
+}
+
+
+
+/* worker thread: */
+
+static void execute(i2c_worker_t *worker, i2c_req_t *req)
+{
+   i2c_dev_t dev;
+   i2c_dev_init(&dev, worker->bus, req->addr);
+   switch (req->type)
+   {
+      case I2C_REQ_WRITE:
+         req->result = i2c_write(&dev, req->val);
+         break;
+
+      case I2C_REQ_WRITE_REG:
+         req->result = i2c_write_reg(&dev, req->reg, req->val);
+         break;
+
+      case I2C_REQ_READ:
+         req->result = i2c_read(&dev);
+         break;
+
+      case I2C_REQ_READ_REG:
+         req->result = i2c_read_reg(&dev, req->reg);
+         break;
+
+      case I2C_REQ_READ_BLOCK_REG:
+         req->result = i2c_read_block_reg(&dev, req->reg, req->buf, req->len);
+         break;
+
+      case I2C_REQ_BATCH:
+      {
+         /* the batch may have been built for a worker bus: */
+         i2c_batch_t batch = *req->batch;
+         batch.bus = worker->bus;
+         req->result = i2c_batch_run(&batch);
+         req->batch->time = batch.time; /* not the time the caller is woken up */
+         break;
+      }
+
+      default:
+         req->result = -EINVAL;
+   }
+}
+
+
+static void *worker_thread(void *arg)
+{
+   i2c_worker_t *worker = (i2c_worker_t *)arg;
+   while (1)
+   {
+      sem_wait(&worker->pending);
+      if (!__atomic_load_n(&worker->running, __ATOMIC_ACQUIRE))
+      {
+         break;
+      }
+
+      /* take the most urgent request: */
+      i2c_req_t *req = NULL;
+      int prio;
+      for (prio = 0; prio < I2C_PRIO_COUNT && req == NULL; prio++)
+      {
+         req = queue_get(&worker->queues[prio]);
+      }
+      if (req == NULL)
+      {
+         continue;
+      }
+
+      execute(worker, req);
+      if (req->done)
+      {
+         req->done(req);
+      }
+      else
+      {
+         while (queue_put(&worker->completed, req) < 0)
+         {
+            sched_yield(); /* completion ring is full, wait for the consumer */
+         }
+      }
+   }
+   return NULL;
+}
+
+
+int i2c_worker_start(i2c_worker_t *worker, i2c_bus_t *bus)
+{
+   worker->bus = bus;
+   int prio;
+   for (prio = 0; prio < I2C_PRIO_COUNT; prio++)
+   {
+      queue_init(&worker->queues[prio]);
+   }
+   queue_init(&worker->completed);
+   int ret = sem_init(&worker->pending, 0, 0);
+   if (ret < 0)
+   {
+      return -errno;
+   }
+   worker->running = 1;
+   ret = pthread_create(&worker->thread, NULL, worker_thread, worker);
+   if (ret != 0)
+   {
+      sem_destroy(&worker->pending);
+      return -ret;
+   }
+   return 0;
+}
+
+
+void i2c_worker_stop(i2c_worker_t *worker)
+{
+   __atomic_store_n(&worker->running, 0, __ATOMIC_RELEASE);
+   sem_post(&worker->pending);
+   pthread_join(worker->thread, NULL);
+   sem_destroy(&worker->pending);
+}
+
+
+int i2c_worker_submit(i2c_worker_t *worker, i2c_req_t *req, i2c_prio_t prio)
+{
+   int ret = queue_put(&worker->queues[prio], req);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   sem_post(&worker->pending);
+   return 0;
+}
+
+
+i2c_req_t *i2c_worker_completed(i2c_worker_t *worker)
+{
+   return queue_get(&worker->completed);
+}
+
+
+
+/* synchronous worker bus backend: */
+
+typedef struct
+{
+   i2c_worker_t *worker;
+   i2c_prio_t prio;
+}
+worker_bus_t;
+
+
+static void wake_submitter(i2c_req_t *req)
+{
+   sem_post((sem_t *)req->arg);
+}
+
+
+static int transact(i2c_bus_t *bus, i2c_req_t *req)
+{
+   worker_bus_t *wbus = (worker_bus_t *)bus->priv;
+   sem_t done;
+   sem_init(&done, 0, 0);
+   req->done = wake_submitter;
+   req->arg = &done;
+   while (i2c_worker_submit(wbus->worker, req, wbus->prio) < 0)
+   {
+      sched_yield(); /* queue is full */
+   }
+   while (sem_wait(&done) < 0 && errno == EINTR);
+   sem_destroy(&done);
+   return req->result;
+}
+
+
+static int worker_write(i2c_bus_t *bus, uint8_t addr, uint8_t val)
+{
+   i2c_req_t req = {.type = I2C_REQ_WRITE, .addr = addr, .val = val};
+   return transact(bus, &req);
+}
+
+
+static int worker_write_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg, uint8_t val)
+{
+   i2c_req_t req = {.type = I2C_REQ_WRITE_REG, .addr = addr, .reg = reg, .val = val};
+   return transact(bus, &req);
+}
+
+
+static int worker_read(i2c_bus_t *bus, uint8_t addr)
+{
+   i2c_req_t req = {.type = I2C_REQ_READ, .addr = addr};
+   return transact(bus, &req);
+}
+
+
+static int worker_read_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg)
+{
+   i2c_req_t req = {.type = I2C_REQ_READ_REG, .addr = addr, .reg = reg};
+   return transact(bus, &req);
+}
+
+
+static int worker_read_block_reg(i2c_bus_t *bus, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len)
+{
+   i2c_req_t req = {.type = I2C_REQ_READ_BLOCK_REG, .addr = addr, .reg = reg, .buf = buf, .len = len};
+   return transact(bus, &req);
+}
+
+
+static int worker_read_batch(i2c_bus_t *bus, i2c_batch_t *batch)
+{
+   i2c_req_t req = {.type = I2C_REQ_BATCH, .batch = batch};
+   return transact(bus, &req);
+}
+
+
+static int worker_close(i2c_bus_t *bus)
+{
+   free(bus->priv);
+   return 0;
+}
+
+
+static const i2c_backend_t worker_backend =
+{
+   worker_write,
+   worker_write_reg,
+   worker_read,
+   worker_read_reg,
+   worker_read_block_reg,
+   worker_read_batch,
+   worker_close
+};
+
+
+int i2c_worker_bus_open(i2c_bus_t *bus, i2c_worker_t *worker, i2c_prio_t prio)
+{
+   worker_bus_t *wbus = malloc(sizeof(worker_bus_t));
+   if (wbus == NULL)
+   {
+      return -ENOMEM;
+   }
+   wbus->worker = worker;
+   wbus->prio = prio;
+   return i2c_bus_init(bus, &worker_backend, wbus);
+}
+
@@ -0,0 +1,126 @@
+
+/*
+   I2C Bus Worker Interface
+
+   A worker thread owns a bus and executes queued transactions in
+   priority order. Requests are passed through lock-free queues,
+   completions are delivered by callback or through a completion ring.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __I2C_WORKER_H__
+#define __I2C_WORKER_H__
+
+
+#include <semaphore.h>
+
+#include "i2c.h"
+
+
+/* queue capacity, must be a power of two: */
+#define I2C_QUEUE_SIZE 64
+
+
+/* request priorities, pending high priority requests are always served first: */
+typedef enum
+{
+   I2C_PRIO_HIGH, /* e.g. gyro/acc reads */
+   I2C_PRIO_LOW, /* e.g. barometer traffic */
+   I2C_PRIO_COUNT
+}
+i2c_prio_t;
+
+
+/* transaction types, mapping to the i2c_* functions: */
+typedef enum
+{
+   I2C_REQ_WRITE,
+   I2C_REQ_WRITE_REG,
+   I2C_REQ_READ,
+   I2C_REQ_READ_REG,
+   I2C_REQ_READ_BLOCK_REG,
+   I2C_REQ_BATCH
+}
+i2c_req_type_t;
+
+
+typedef struct i2c_req
+{
+   /* transaction: */
+   i2c_req_type_t type;
+   uint8_t addr;
+   uint8_t reg;
+   uint8_t val;
+   uint8_t *buf;
+   size_t len;
+   i2c_batch_t *batch;
+
+   /* return value of the transaction: */
+   int result;
+
+   /* completion callback, runs in the worker thread;
+      if NULL, the request is put into the completion ring: */
+   void (*done)(struct i2c_req *req);
+   void *arg;
+}
+i2c_req_t;
+
+
+/* bounded lock-free multi-producer/multi-consumer queue: */
+typedef struct
+{
+   struct
+   {
+      size_t seq;
+      i2c_req_t *req;
+   }
+   cells[I2C_QUEUE_SIZE];
+   size_t head;
+   size_t tail;
+}
+i2c_queue_t;
+
+
+typedef struct
+{
+   i2c_bus_t *bus;
+   pthread_t thread;
+   int running;
+   sem_t pending; /* counts queued requests */
+   i2c_queue_t queues[I2C_PRIO_COUNT];
+   i2c_queue_t completed;
+}
+i2c_worker_t;
+
+
+/* starts a worker thread serving bus */
+int i2c_worker_start(i2c_worker_t *worker, i2c_bus_t *bus);
+
+/* stops the worker thread after the current transaction */
+void i2c_worker_stop(i2c_worker_t *worker);
+
+/* queues a request without blocking, returns -EAGAIN if the queue is full */
+int i2c_worker_submit(i2c_worker_t *worker, i2c_req_t *req, i2c_prio_t prio);
+
+/* takes a request from the completion ring, returns NULL if empty */
+i2c_req_t *i2c_worker_completed(i2c_worker_t *worker);
+
+/* opens a bus whose transactions are executed synchronously by the worker
+   using the given priority; allows unchanged drivers to share a worker */
+int i2c_worker_bus_open(i2c_bus_t *bus, i2c_worker_t *worker, i2c_prio_t prio);
+
+
+#endif /* __I2C_WORKER_H__ */
+
@@ -6,14 +6,18 @@
  * | 1 dt | * | p | + | 0.5 * dt ^ 2 | * | a | = | p |
  * | 0  1 | * | v |   |     dt       |   | v |
  *
+ * only the position is observed (H = | 1 0 |), so the matrix
+ * equations reduce to the closed-form expressions below
+ *
  * authors:
  * Tobias Simon, Ilmenau University of Technology
  * Jan Roemisch, Ilmenau University of Technology
  */
 
 
-#include <meschach/matrix2.h>
-
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
 
 #include "kalman.h"
 
@@ -21,112 +25,181 @@
 
 void kalman_init(kalman_t *kf, float q, float r, float pos, float speed)
 {
-   kf->t0 = v_get(2);
-   kf->t1 = v_get(2);
-   kf->T0 = m_get(2, 2);
-   kf->T1 = m_get(2, 2);
-   
-   kf->I = m_get(2, 2);
-   m_ident(kf->I);
+   kf->q = q;
+   kf->r = r;
 
    /* set initial state: */
-   kf->x = v_get(2);
-   v_set_val(kf->x, 0, pos);
-   v_set_val(kf->x, 1, speed);
-
-   /* no measurement or control yet: */
-   kf->z = v_get(2);
-   kf->u = v_get(1);
-
-   kf->P = m_get(2, 2);
-   m_ident(kf->P);
-   
-   /* set up noise: */
-   kf->Q = m_get(2, 2);
-   sm_mlt(q, kf->I, kf->Q);
-   kf->R = m_get(2, 2);
-   sm_mlt(r, kf->I, kf->R);
-   
-   kf->K = m_get(2, 1);
-   kf->H = m_get(2, 2);
-   m_set_val(kf->H, 0, 0, 1.0);
-   //m_ident(kf->H);
-    
-   /* A = | 1.0   dt  |
-          | 0.0   1.0 |
-      dt values is set in kalman_run */
-   kf->A = m_get(2, 2);
-   m_set_val(kf->A, 0, 0, 1.0);
-   m_set_val(kf->A, 1, 0, 0.0);
-   m_set_val(kf->A, 1, 1, 1.0);
-
-   /* B = | 0.5 * dt ^ 2 |
-          |     dt       |
-      dt values are set in kalman_run */
-   kf->B = m_get(2, 1);
+   kf->pos = pos;
+   kf->speed = speed;
+
+   /* P = I */
+   kf->P00 = 1.0f;
+   kf->P01 = 0.0f;
+   kf->P11 = 1.0f;
+
+   kf->gains = NULL;
 }
 
 
-static void kalman_predict(kalman_t *kf, float a)
+/* P = A * P * AT + Q */
+static void kalman_predict_cov(kalman_t *kf, float dt)
 {
-   /* x = A * x + B * u */
-   v_set_val(kf->u, 0, a);
-   mv_mlt(kf->A, kf->x, kf->t0);
-   mv_mlt(kf->B, kf->u, kf->t1);
-   v_add(kf->t0, kf->t1, kf->x);
-
-   /* P = A * P * AT + Q */
-   m_mlt(kf->A, kf->P, kf->T0);
-   mmtr_mlt(kf->T0, kf->A, kf->T1);
-   m_add(kf->T1, kf->Q, kf->P);
+   kf->P00 += dt * (2.0f * kf->P01 + dt * kf->P11) + kf->q;
+   kf->P01 += dt * kf->P11;
+   kf->P11 += kf->q;
 }
 
 
+/* x = A * x + B * u */
+static void kalman_predict_state(float *pos, float *speed, float a, float dt)
+{
+   *pos += dt * *speed + 0.5f * dt * dt * a;
+   *speed += dt * a;
+}
+
+
+/* K = P * HT * inv(H * P * HT + R), then P = (I - K * H) * P */
+static void kalman_correct_cov(kalman_t *kf, float *k0, float *k1)
+{
+   float s = kf->P00 + kf->r;
+   *k0 = kf->P00 / s;
+   *k1 = kf->P01 / s;
+   kf->P11 -= *k1 * kf->P01;
+   kf->P01 -= *k0 * kf->P01;
+   kf->P00 -= *k0 * kf->P00;
+}
+
+
+/* x = x + K * (z - H * x) */
+static void kalman_correct_state(float *pos, float *speed, float k0, float k1, float p)
+{
+   float y = p - *pos;
+   *pos += k0 * y;
+   *speed += k1 * y;
+}
+
 
-static void kalman_correct(kalman_t *kf, float p, float v)
+/* propagates the covariance and returns the gain for a correction, from the cached gains if possible: */
+static void kalman_step_cov(kalman_t *kf, float dt, int correct, float *k0, float *k1)
 {
-   /* K = P * HT * inv(H * P * HT + R) */
-   m_mlt(kf->H, kf->P, kf->T0);
-   mmtr_mlt(kf->T0, kf->H, kf->T1);
-   m_add(kf->T1, kf->R, kf->T0);
-   m_inverse(kf->T0, kf->T1);
-   mmtr_mlt(kf->P, kf->H, kf->T0);
-   m_mlt(kf->T0, kf->T1, kf->K);
-
-   /* x = x + K * (z - H * x) */
-   mv_mlt(kf->H, kf->x, kf->t0);
-   v_set_val(kf->z, 0, p);
-   v_set_val(kf->z, 1, v);
-   v_sub(kf->z, kf->t0, kf->t1);
-   mv_mlt(kf->K, kf->t1, kf->t0);
-   v_add(kf->x, kf->t0, kf->t1);
-   v_copy(kf->t1, kf->x);
-   
-   /* P = (I - K * H) * P */
-   m_mlt(kf->K, kf->H, kf->T0);
-   m_sub(kf->I, kf->T0, kf->T1);
-   m_mlt(kf->T1, kf->P, kf->T0);
-   m_copy(kf->T0, kf->P);
+   const kalman_gains_t *gains = kf->gains;
+   if (correct && gains != NULL)
+   {
+      int i = (int)floorf((dt - gains->dt_min) / gains->dt_step + 0.5f);
+      if (i >= 0 && i < gains->size)
+      {
+         *k0 = gains->k0[i];
+         *k1 = gains->k1[i];
+
+         /* keep P up to date for a fall back to full propagation: */
+         kf->P00 = gains->P00[i];
+         kf->P01 = gains->P01[i];
+         kf->P11 = gains->P11[i];
+         return;
+      }
+   }
+   kalman_predict_cov(kf, dt);
+   if (correct)
+   {
+      kalman_correct_cov(kf, k0, k1);
+   }
 }
 
 
 /*
- * executes kalman predict and correct step
+ * executes kalman predict step and, for a new position, correct step
  */
 void kalman_run(kalman_out_t *out, kalman_t *kalman, const kalman_in_t *in)
 {
-   /* A = | init   dt  |
-          | init  init | */
-   m_set_val(kalman->A, 0, 1, in->dt);
-
-   /* B = | 0.5 * dt ^ 2 |
-          |     dt       | */
-   m_set_val(kalman->B, 0, 0, 0.5 * in->dt * in->dt);
-   m_set_val(kalman->B, 1, 0, in->dt);
-
-   kalman_predict(kalman, in->acc);
-   kalman_correct(kalman, in->pos, in->speed);
-   out->pos = v_entry(kalman->x, 0);
-   out->speed = v_entry(kalman->x, 1);
+   float k0, k1;
+   kalman_step_cov(kalman, in->dt, in->pos_dt >= 0.0f, &k0, &k1);
+   kalman_predict_state(&kalman->pos, &kalman->speed, in->acc, in->dt);
+   if (in->pos_dt >= 0.0f)
+   {
+      /* the position was sampled pos_dt ago, move it along with the estimated speed: */
+      kalman_correct_state(&kalman->pos, &kalman->speed, k0, k1, in->pos + in->pos_dt * kalman->speed);
+   }
+   out->pos = kalman->pos;
+   out->speed = kalman->speed;
 }
 
+
+int kalman_multi_init(kalman_multi_t *kf, int axes, float q, float r)
+{
+   if (axes < 1 || axes > KALMAN_MAX_AXES)
+   {
+      return -EINVAL;
+   }
+   kf->axes = axes;
+   kalman_init(&kf->cov, q, r, 0.0f, 0.0f);
+   int i;
+   for (i = 0; i < axes; i++)
+   {
+      kf->pos[i] = 0.0f;
+      kf->speed[i] = 0.0f;
+   }
+   return 0;
+}
+
+
+void kalman_multi_run(kalman_out_t *out, kalman_multi_t *kalman, const kalman_multi_in_t *in)
+{
+   /* the covariance and gain do not depend on the measurements, so they are computed once: */
+   float k0, k1;
+   kalman_step_cov(&kalman->cov, in->dt, in->pos_dt >= 0.0f, &k0, &k1);
+   int i;
+   for (i = 0; i < kalman->axes; i++)
+   {
+      kalman_predict_state(&kalman->pos[i], &kalman->speed[i], in->acc[i], in->dt);
+      if (in->pos_dt >= 0.0f)
+      {
+         kalman_correct_state(&kalman->pos[i], &kalman->speed[i], k0, k1, in->pos[i] + in->pos_dt * kalman->speed[i]);
+      }
+      out[i].pos = kalman->pos[i];
+      out[i].speed = kalman->speed[i];
+   }
+}
+
+
+int kalman_gains_init(kalman_gains_t *gains, float q, float r, float dt_min, float dt_step, int size)
+{
+   if (size < 1 || size > KALMAN_MAX_GAINS || dt_step <= 0.0f)
+   {
+      return -EINVAL;
+   }
+   gains->dt_min = dt_min;
+   gains->dt_step = dt_step;
+   gains->size = size;
+   int i;
+   for (i = 0; i < size; i++)
+   {
+      /* iterate predict and correct in double precision until P converges: */
+      double dt = dt_min + i * dt_step;
+      double P00 = 1.0, P01 = 0.0, P11 = 1.0;
+      double k0 = 0.0, k1 = 0.0;
+      int n;
+      for (n = 0; n < 1000000; n++)
+      {
+         double prev00 = P00, prev11 = P11;
+         P00 += dt * (2.0 * P01 + dt * P11) + q;
+         P01 += dt * P11;
+         P11 += q;
+         double s = P00 + r;
+         k0 = P00 / s;
+         k1 = P01 / s;
+         P11 -= k1 * P01;
+         P01 -= k0 * P01;
+         P00 -= k0 * P00;
+         if (fabs(P00 - prev00) <= 1.0e-12 * P00 && fabs(P11 - prev11) <= 1.0e-12 * P11)
+         {
+            break;
+         }
+      }
+      gains->k0[i] = k0;
+      gains->k1[i] = k1;
+      gains->P00[i] = P00;
+      gains->P01[i] = P01;
+      gains->P11[i] = P11;
+   }
+   return 0;
+}
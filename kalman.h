@@ -17,36 +17,62 @@
 #define __KALMAN_H__
 
 
-#include <meschach/matrix.h>
+#define KALMAN_MAX_GAINS 32
 
 
+/* steady-state gains of filters corrected every step, keyed by dt: */
+typedef struct
+{
+   float dt_min; /* dt of the first entry */
+   float dt_step; /* dt spacing and width of the entries */
+   int size;
+
+   /* gain and covariance after the correction: */
+   float k0[KALMAN_MAX_GAINS];
+   float k1[KALMAN_MAX_GAINS];
+   float P00[KALMAN_MAX_GAINS];
+   float P01[KALMAN_MAX_GAINS];
+   float P11[KALMAN_MAX_GAINS];
+}
+kalman_gains_t;
+
 
 typedef struct
 {
-   /* configuration and constant matrices: */
-   MAT *Q; /* process noise */
-   MAT *R; /* measurement noise */
-   MAT *I; /* identity matrix */
-
-   /* state and transition vectors/matrices: */
-   VEC *x; /* state (location and velocity) */
-   VEC *z; /* measurement (location) */
-   MAT *A; /* system matrix */
-   MAT *B; /* control matrix */
-   MAT *P; /* error covariance */
-   VEC *u; /* control (acceleration) */
-   MAT *H; /* observer matrix */
-   MAT *K; /* kalman gain */
-
-   /*  vectors and matrices for calculations: */
-   VEC *t0;
-   VEC *t1;
-   MAT *T0;
-   MAT *T1;
+   /* configuration: */
+   float q; /* process noise */
+   float r; /* measurement noise */
+
+   /* state (location and velocity): */
+   float pos;
+   float speed;
+
+   /* error covariance, symmetric: */
+   float P00;
+   float P01;
+   float P11;
+
+   /* cached gains used instead of propagating P, or NULL: */
+   const kalman_gains_t *gains;
 }
 kalman_t;
 
 
+#define KALMAN_MAX_AXES 8
+
+
+/* axes driven with the same dt and position timing, e.g. north and east,
+   share one covariance and gain: */
+typedef struct
+{
+   int axes;
+   kalman_t cov; /* noise and covariance, its state is unused */
+   float pos[KALMAN_MAX_AXES];
+   float speed[KALMAN_MAX_AXES];
+}
+kalman_multi_t;
+
+
 typedef struct
 {
    float pos;
@@ -57,16 +83,27 @@ kalman_out_t;
 
 typedef struct
 {
-   float dt; /* time elapsed since last kalman step */
+   float dt; /* time elapsed since last kalman step, between the acceleration samples */
    float pos; /* position in m */
+   float pos_dt; /* age of the position at this step, negative if it is not new */
    float speed;
    float acc; /* acceleration min m/s^2 */
 }
 kalman_in_t;
 
 
+typedef struct
+{
+   float dt; /* see kalman_in_t */
+   float pos_dt;
+   const float *pos; /* one value per axis */
+   const float *acc;
+}
+kalman_multi_in_t;
+
+
 /*
- * executes kalman predict and correct step
+ * executes kalman predict step and, for a new position, correct step
  */
 void kalman_run(kalman_out_t *out, kalman_t *kalman, const kalman_in_t *in);
 
@@ -77,5 +114,26 @@ void kalman_run(kalman_out_t *out, kalman_t *kalman, const kalman_in_t *in);
 void kalman_init(kalman_t *kf, float q, float r, float pos, float speed);
 
 
+/*
+ * executes kalman_run for all axes, writing one output per axis
+ */
+void kalman_multi_run(kalman_out_t *out, kalman_multi_t *kalman, const kalman_multi_in_t *in);
+
+
+/*
+ * initializes a multi-axis kalman filter at rest in the origin,
+ * returns 0 or -EINVAL for more than KALMAN_MAX_AXES axes
+ */
+int kalman_multi_init(kalman_multi_t *kf, int axes, float q, float r);
+
+
+/*
+ * solves the riccati equation for size dt values from dt_min on, spaced by dt_step;
+ * a filter using the gains falls back to full propagation for other dt values
+ * and steps without position; returns 0 or -EINVAL
+ */
+int kalman_gains_init(kalman_gains_t *gains, float q, float r, float dt_min, float dt_step, int size);
+
+
 #endif /* __KALMAN_H__ */
 
@@ -18,6 +18,7 @@
 
 #include "kalman.h"
 #include <stdio.h>
+#include <stdlib.h>
 
 
 /* 
@@ -33,6 +34,11 @@ int main(int argc, void *argv[])
       return EXIT_FAILURE;
    }
    kalman_init(&kalman, atof(argv[1]), atof(argv[2]), 0.0f, 0.0f);
+
+   /* every line has the same dt and a position, so the gain is constant: */
+   kalman_gains_t gains;
+   kalman_gains_init(&gains, atof(argv[1]), atof(argv[2]), 0.0033333, 0.0001, 1);
+   kalman.gains = &gains;
    char buffer[1024];
    int c, i = 0;
    while ((c = getchar()) != EOF)
@@ -46,6 +52,7 @@ int main(int argc, void *argv[])
          buffer[i] = '\0';
          kalman_in_t kalman_in;
          kalman_in.dt = 0.0033333;
+         kalman_in.pos_dt = 0.0; /* every line has a position */
          sscanf(buffer, "%f %f", &kalman_in.acc, &kalman_in.pos);
          kalman_out_t kalman_out;
          kalman_run(&kalman_out, &kalman, &kalman_in);
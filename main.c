@@ -17,26 +17,30 @@
 
 
 #include "kalman.h"
-#include "chips/ms5611/ms5611.h"
-#include "chips/itg3200/itg3200.h"
-#include "chips/bma180/bma180.h"
-#include "chips/hmc5883/hmc5883.h"
+#include "chips/sensor.h"
 
 #include "i2c/i2c.h"
+#include "i2c/i2c_sim.h"
+#include "i2c/i2c_worker.h"
+#include "i2c/i2c_replay.h"
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 
 #include "ahrs/madgwick_ahrs.h"
+#include "ahrs/gyro_bias.h"
 #include "ahrs/util.h"
 #include "util/udp4.h"
 #include "util/interval.h"
+#include "util/drdy.h"
 #include "util/math.h"
 #include "util/sliding_avg.h"
 
 #include <errno.h>
 #include <stdlib.h>
 #include <math.h>
+#include <signal.h>
+#include <unistd.h>
 
 
 #define STANDARD_BETA 0.5
@@ -47,101 +51,202 @@
 
 void fatal(char *msg, int code)
 {
-   int index = -code;
-   if (index < sys_nerr)
-   {
-      fprintf(stderr, "fatal error: %s, code %d (%s)\n", msg, code, sys_errlist[index]);
-   }
-   else
-   {
-      fprintf(stderr, "fatal error: %s, code %d\n", msg, code);
-   }
+   fprintf(stderr, "fatal error: %s, code %d (%s)\n", msg, code, strerror(-code));
 }
 
-#include <pthread.h>
+/* SIGUSR1 requests a dump of the i2c statistics: */
+static volatile sig_atomic_t dump_stats = 0;
 
-float alt_start = 0.0;
-float alt_rel = 0.0;
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+/* SIGINT and SIGTERM end the main loop, flushing a recorded trace: */
+static volatile sig_atomic_t running = 1;
 
 
-void *ms5611_reader(void *arg)
+static void dump_stats_handler(int sig)
 {
-   ms5611_dev_t *ms = (ms5611_dev_t *)arg;
-   ms5611_measure(ms);
-   alt_start = ms->c_a;
-   float last_alt_rel = 0.0;
-   while (1)
-   {
-      ms5611_measure(ms);
-      pthread_mutex_lock(&mutex);
-      alt_rel = ms->c_a - alt_start;
-      if (fabs(alt_rel - last_alt_rel) > 10.0)
-      {
-         alt_rel = last_alt_rel;
-      }
-      pthread_mutex_unlock(&mutex);
+   dump_stats = 1;
+}
+
+
+static void terminate_handler(int sig)
+{
+   running = 0;
+}
+
+
+static void dump_bus_stats(char *name, i2c_bus_t *bus)
+{
+   i2c_stats_t *stats = malloc(sizeof(i2c_stats_t));
+   if (stats != NULL && i2c_bus_stats(bus, stats) == 0)
+   {
+      fprintf(stderr, "%s:\n", name);
+      i2c_stats_dump(stats, stderr);
    }
+   free(stats);
 }
 
 
-int main(void)
+static int sim_bus_open(i2c_bus_t *bus)
 {
+   int ret = i2c_sim_bus_open(bus);
+   if (ret < 0)
+   {
+      return ret;
+   }
+   i2c_sim_chip_t chips[] = {I2C_SIM_ITG3200, I2C_SIM_BMA180, I2C_SIM_HMC5883, I2C_SIM_MS5611};
+   int i;
+   for (i = 0; i < 4 && ret == 0; i++)
+   {
+      ret = i2c_sim_attach(bus, chips[i]);
+   }
+   return ret;
+}
+
+
+/*
+ * usage: [-r trace file to record] [-i ITG3200 data-ready GPIO value file or device]
+ *        [i2c bus device, 'sim' for the simulated bus or 'replay:<trace file>']
+ */
+int main(int argc, char *argv[])
+{
+   char *record_path = NULL;
+   char *drdy_path = NULL;
+   int opt;
+   while ((opt = getopt(argc, argv, "r:i:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'r':
+            record_path = optarg;
+            break;
+
+         case 'i':
+            drdy_path = optarg;
+            break;
+
+         default:
+            fprintf(stderr, "usage: %s [-r trace] [-i data-ready] [bus]\n", argv[0]);
+            return EXIT_FAILURE;
+      }
+   }
+   char *bus_path = optind < argc ? argv[optind] : "/dev/i2c-3";
    i2c_bus_t bus;
-   int ret = i2c_bus_open(&bus, "/dev/i2c-3");
+   int ret;
+   int sim = strcmp(bus_path, "sim") == 0;
+   int replay = strncmp(bus_path, "replay:", 7) == 0;
+   if (sim)
+   {
+      ret = sim_bus_open(&bus);
+   }
+   else if (replay)
+   {
+      ret = i2c_replay_bus_open(&bus, bus_path + 7);
+   }
+   else
+   {
+      ret = i2c_bus_open(&bus, bus_path);
+   }
    if (ret < 0)
    {
       fatal("could not open i2c bus", ret);
       return EXIT_FAILURE;
    }
-
-   /* ITG: */
-   itg3200_dev_t itg;
-itg_again:
-   ret = itg3200_init(&itg, &bus, ITG3200_DLPF_42HZ);
-   if (ret < 0)
+   if (record_path != NULL)
    {
-      fatal("could not inizialize ITG3200", ret);
-      if (ret == -EAGAIN)
+      ret = i2c_bus_record(&bus, record_path);
+      if (ret < 0)
       {
-         goto itg_again;   
+         fatal("could not create i2c trace", ret);
+         return EXIT_FAILURE;
       }
-      return EXIT_FAILURE;
    }
 
-   /* BMA: */
-   bma180_dev_t bma;
-   bma180_init(&bma, &bus, BMA180_RANGE_4G, BMA180_BW_10HZ);
+   /* a worker thread owns the bus, IMU reads preempt queued barometer traffic: */
+   i2c_worker_t worker;
+   ret = i2c_worker_start(&worker, &bus);
+   if (ret < 0)
+   {
+      fatal("could not start i2c worker", ret);
+      return EXIT_FAILURE;
+   }
+   i2c_bus_t imu_bus, baro_bus;
+   i2c_worker_bus_open(&imu_bus, &worker, I2C_PRIO_HIGH);
+   i2c_worker_bus_open(&baro_bus, &worker, I2C_PRIO_LOW);
 
-   /* HMC: */
-   hmc5883_dev_t hmc;
-   hmc5883_init(&hmc, &bus);
-   
-   /* MS: */
-   ms5611_dev_t ms;
-   ret = ms5611_init(&ms, &bus, MS5611_OSR4096, MS5611_OSR4096);
+   /* sensors of the board, the barometer may be delayed by IMU traffic: */
+   const sensor_desc_t board[] =
+   {
+      {"itg3200", &imu_bus, 0},
+      {"bma180", &imu_bus, 1},
+      {"hmc5883", &imu_bus, 1},
+      {"ms5611", &baro_bus, 0}
+   };
+   sensor_registry_t sensors;
+   ret = sensor_registry_init(&sensors, board, sizeof(board) / sizeof(board[0]));
    if (ret < 0)
    {
-      fatal("could not inizialize MS5611", ret);
+      fatal("could not initialize sensors", ret);
       return EXIT_FAILURE;
    }
-   pthread_t thread;
-   pthread_create(&thread, NULL, ms5611_reader, &ms);
+   sensor_t *gyro = sensor_registry_find(&sensors, SENSOR_GYRO);
+   if (gyro == NULL)
+   {
+      /* the loop is scheduled by the gyro: */
+      fatal("no gyro on the board", -ENODEV);
+      return EXIT_FAILURE;
+   }
+
+   /* the magnetometer is calibrated online, the fit is refreshed every second: */
+   mag_cal_t mag_cal;
+   mag_cal_init(&mag_cal, 3000); /* one minute at 50Hz */
+   sensor_t *mag = sensor_registry_find(&sensors, SENSOR_MAG);
+   if (mag != NULL && mag->mag_cal != NULL)
+   {
+      mag_cal_start(&mag_cal, mag->mag_cal, 1000);
+   }
+
+   /* the loop is paced by the gyro's data-ready interrupt, if available: */
+   drdy_t drdy;
+   int use_drdy = 0;
+   if (drdy_path != NULL)
+   {
+      ret = drdy_open(&drdy, drdy_path);
+      if (ret < 0)
+      {
+         fatal("could not open data-ready input", ret);
+         return EXIT_FAILURE;
+      }
+      if (gyro->driver->int_enable != NULL)
+      {
+         gyro->driver->int_enable(gyro);
+      }
+      use_drdy = 1;
+   }
+   else if (sim)
+   {
+      /* stand-in for the simulated gyro's 1kHz interrupt: */
+      drdy_open_timer(&drdy, 1000000);
+      use_drdy = 1;
+   }
+
+   /* gyro bias, refined whenever the vehicle rests for a second: */
+   gyro_bias_t gyro_bias;
+   gyro_bias_init(&gyro_bias, 1000, 20, 1.0e-3, 0.05, 10000, 5.0e-3, 10);
 
    /* initialize AHRS filter: */
    madgwick_ahrs_t madgwick_ahrs;
    madgwick_ahrs_init(&madgwick_ahrs, STANDARD_BETA);
 
-   interval_t interval;
-   interval_init(&interval);
    float init = START_BETA;
    udp_socket_t *socket = udp_socket_create("10.0.0.100", 5005, 0, 0);
 
    /* kalman filter: */
-   kalman_t kalman1, kalman2, kalman3;
-   kalman_init(&kalman1, 1.0e-6, 1.0e-2, 0, 0);
-   kalman_init(&kalman2, 1.0e-6, 1.0e-2, 0, 0);
-   kalman_init(&kalman3, 1.0e-6, 1.0e-2, 0, 0);
+   kalman_multi_t kalman_ne; /* north and east, corrected every step */
+   kalman_t kalman_d; /* down, corrected per barometer sample */
+   kalman_multi_init(&kalman_ne, 2, 1.0e-6, 1.0e-2);
+   kalman_gains_t kalman_ne_gains; /* for 20 Hz +- 20% acceleration samples */
+   kalman_gains_init(&kalman_ne_gains, 1.0e-6, 1.0e-2, 0.04, 0.001, 21);
+   kalman_ne.cov.gains = &kalman_ne_gains;
+   kalman_init(&kalman_d, 1.0e-6, 1.0e-2, 0, 0);
    vec3_t global_acc; /* x = N, y = E, z = D */
    int init_done = 0;
    int converged = 0;
@@ -149,12 +254,83 @@ itg_again:
    avg[0] = sliding_avg_create(1000, 0.0);
    avg[1] = sliding_avg_create(1000, 0.0);
    avg[2] = sliding_avg_create(1000, -9.81);
+   float alt_start = 0.0;
+   float alt_rel = 0.0;
    float alt_rel_last = 0.0;
+   int alt_valid = 0;
    int udp_cnt = 0;
-   while (1)
+   /* sample times of the last fusion steps, each filter integrates over its own sensor's interval: */
+   uint64_t gyro_time = 0;
+   uint64_t acc_time = 0;
+   uint64_t baro_time = 0;
+   sensor_sample_t sample;
+   memset(&sample, 0, sizeof(sample));
+   signal(SIGUSR1, dump_stats_handler);
+   signal(SIGINT, terminate_handler);
+   signal(SIGTERM, terminate_handler);
+
+   while (running)
    {
       int i;
-      float dt = interval_measure(&interval);
+      if (use_drdy && !replay)
+      {
+         /* on timeout, read anyway in case an edge was missed: */
+         drdy_wait(&drdy, 100);
+      }
+
+      if (dump_stats)
+      {
+         dump_stats = 0;
+         dump_bus_stats("bus", &bus); /* raw transaction times */
+         dump_bus_stats("imu", &imu_bus); /* including worker queueing */
+         dump_bus_stats("baro", &baro_bus);
+      }
+
+      /* sensor data acquisition, the IMU registers of all due sensors in one combined transfer;
+         scheduled by the completion time of the last gyro transfer, advancing by one gyro period per loop,
+         which is recorded in a trace, so a replay takes the same steps: */
+      uint64_t now = gyro->time + gyro->period;
+      ret = sensor_registry_read(&sensors, now);
+      if (replay && ret == -ENODATA)
+      {
+         break; /* end of trace */
+      }
+      now = gyro->time;
+
+      /* barometer steps are interleaved with IMU reads: */
+      int fresh = sensor_registry_update(&sensors, now, &sample);
+      if (fresh & SENSOR_BARO)
+      {
+         if (!alt_valid)
+         {
+            alt_start = sample.altitude;
+            alt_valid = 1;
+         }
+         /* reject spikes: */
+         alt_rel = sample.altitude - alt_start;
+         if (fabs(alt_rel - alt_rel_last) > 10.0)
+         {
+            alt_rel = alt_rel_last;
+         }
+         alt_rel_last = alt_rel;
+      }
+      if (fresh & SENSOR_MAG)
+      {
+         mag_cal_add(&mag_cal, &sample.mag_raw);
+      }
+      if (fresh & SENSOR_ACC)
+      {
+         gyro_bias_add_acc(&gyro_bias, &sample.acc);
+      }
+
+      /* fusion runs once per fresh gyro sample,
+         stale accelerometer and magnetometer data is reused until it is refreshed: */
+      if (!(fresh & SENSOR_GYRO))
+      {
+         continue;
+      }
+      float dt = gyro_time ? (sample.gyro_time - gyro_time) / 1.0e9 : 0.0;
+      gyro_time = sample.gyro_time;
       init -= BETA_STEP;
       if (init < FINAL_BETA)
       {
@@ -163,38 +339,49 @@ itg_again:
       }
       madgwick_ahrs.beta = init;
       
-      /* sensor data acquisition: */
-      itg3200_read_gyro(&itg);
-      bma180_read_acc(&bma);
-      hmc5883_read(&hmc);
-      
       /* state estimates and output: */
+      vec3_t gyro_rate;
+      gyro_bias_update(&gyro_bias, &gyro_rate, &sample.gyro);
       euler_t euler;
-      madgwick_ahrs_update(&madgwick_ahrs, itg.gyro.x, itg.gyro.y, itg.gyro.z, bma.raw.x, bma.raw.y, bma.raw.z, hmc.raw.x, hmc.raw.y, hmc.raw.z, 11.0, dt);
+      madgwick_ahrs_update(&madgwick_ahrs, gyro_rate.x, gyro_rate.y, gyro_rate.z, sample.acc.x, sample.acc.y, sample.acc.z, sample.mag.x, sample.mag.y, sample.mag.z, 11.0, dt);
       
       quat_t q_body_to_world;
       quat_copy(&q_body_to_world, &madgwick_ahrs.quat);
-      quat_rot_vec(&global_acc, &bma.raw, &q_body_to_world);
+      quat_rot_vec(&global_acc, &sample.acc, &q_body_to_world);
       for (i = 0; i < 3; i++)
       {
          global_acc.vec[i] -= sliding_avg_calc(avg[i], global_acc.vec[i]);
       }
+      if (sample.acc_time == acc_time)
+      {
+         continue; /* no new acceleration to integrate */
+      }
+      float acc_dt = acc_time ? (sample.acc_time - acc_time) / 1.0e9 : 0.0;
+      acc_time = sample.acc_time;
       if (init_done)
       {
+         const float ne_pos[2] = {0.0f, 0.0f};
+         const float ne_acc[2] = {global_acc.x, global_acc.y};
+         kalman_multi_in_t kalman_ne_in;
+         kalman_ne_in.dt = acc_dt;
+         kalman_ne_in.pos_dt = 0.0;
+         kalman_ne_in.pos = ne_pos;
+         kalman_ne_in.acc = ne_acc;
+         kalman_out_t kalman_ne_out[2];
+         kalman_multi_run(kalman_ne_out, &kalman_ne, &kalman_ne_in);
+
          kalman_in_t kalman_in;
-         kalman_in.dt = dt;
-         kalman_in.pos = 0;
          kalman_out_t kalman_out;
-
-         kalman_in.acc = global_acc.x;
-         kalman_run(&kalman_out, &kalman1, &kalman_in);
-         kalman_in.acc = global_acc.y;
-         kalman_run(&kalman_out, &kalman2, &kalman_in);
+         kalman_in.dt = acc_dt;
          kalman_in.acc = -global_acc.z;
-         pthread_mutex_lock(&mutex);
          kalman_in.pos = alt_rel;
-         pthread_mutex_unlock(&mutex);
-         kalman_run(&kalman_out, &kalman3, &kalman_in);
+         kalman_in.pos_dt = -1.0; /* the altitude corrects the estimate once per barometer sample */
+         if (sample.baro_time != baro_time)
+         {
+            baro_time = sample.baro_time;
+            kalman_in.pos_dt = baro_time < acc_time ? (acc_time - baro_time) / 1.0e9 : 0.0;
+         }
+         kalman_run(&kalman_out, &kalman_d, &kalman_in);
          if (!converged)
          {
             if (fabs(kalman_out.pos - alt_rel) < 0.1)
@@ -220,6 +407,10 @@ itg_again:
 
       
    }
+   mag_cal_stop(&mag_cal);
+   sensor_registry_close(&sensors);
+   i2c_worker_stop(&worker);
+   i2c_bus_close(&bus);
    return 0;
 }
 
@@ -18,14 +18,17 @@
 
 #include "kalman.h"
 #include "chips/mpu6050/mpu6050.h"
+#include "chips/hmc5883/hmc5883.h"
 
 #include "i2c/i2c.h"
+#include "i2c/i2c_sim.h"
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 
 #include "ahrs/util.h"
 #include "util/interval.h"
+#include "util/drdy.h"
 #include "util/math.h"
 #include "util/sliding_avg.h"
 
@@ -34,10 +37,32 @@
 #include <math.h>
 
 
-int main(void)
+/*
+ * argv: "[i2c bus device, or 'sim' for the simulated bus] [data-ready GPIO value file or device]",
+ * the data-ready input is only used with a magnetometer on the auxiliary bus
+ */
+int main(int argc, char *argv[])
 {
+   char *bus_path = argc > 1 ? argv[1] : "/dev/i2c-0";
    i2c_bus_t bus;
-   int ret = i2c_bus_open(&bus, "/dev/i2c-0");
+   int ret;
+   int sim = strcmp(bus_path, "sim") == 0;
+   if (sim)
+   {
+      ret = i2c_sim_bus_open(&bus);
+      if (ret == 0)
+      {
+         ret = i2c_sim_attach(&bus, I2C_SIM_MPU6050);
+      }
+      if (ret == 0)
+      {
+         ret = i2c_sim_attach(&bus, I2C_SIM_HMC5883); /* on the auxiliary bus */
+      }
+   }
+   else
+   {
+      ret = i2c_bus_open(&bus, bus_path);
+   }
    if (ret < 0)
    {
       printf("could not open i2c bus", ret);
@@ -46,9 +71,80 @@ int main(void)
 
    mpu6050_dev_t mpu;
    mpu6050_init(&mpu, &bus, MPU6050_DLPF_CFG_94_98Hz, MPU6050_FS_SEL_500, MPU6050_AFS_SEL_4G);
+
+   /* a magnetometer on the auxiliary bus is configured through bypass mode,
+      then sampled by the MPU6050 at 50Hz and returned with each burst read: */
+   hmc5883_dev_t hmc;
+   int aux_mag = 0;
+   mpu6050_aux_bypass(&mpu, 1);
+   if (hmc5883_init(&hmc, &bus) == 0)
+   {
+      aux_mag = mpu6050_aux_add_read(&mpu, hmc.i2c_dev.addr, HMC5883_DATA_REG, hmc.buf, sizeof(hmc.buf), 19) == 0;
+   }
+   else
+   {
+      mpu6050_aux_bypass(&mpu, 0);
+   }
+
+   /* without magnetometer, 1kHz samples are collected by the FIFO and drained in bursts: */
+   if (!aux_mag)
+   {
+      ret = mpu6050_fifo_enable(&mpu, 0);
+      if (ret < 0)
+      {
+         printf("could not enable MPU6050 FIFO: %d\n", ret);
+         return EXIT_FAILURE;
+      }
+   }
+
+   /* in auxiliary master mode, wake up per sample if the INT pin is connected;
+      the FIFO is drained in bursts and must not be woken up per sample: */
+   drdy_t drdy;
+   int use_drdy = 0;
+   if (aux_mag && argc > 2)
+   {
+      ret = drdy_open(&drdy, argv[2]);
+      if (ret < 0)
+      {
+         printf("could not open data-ready input: %d\n", ret);
+         return EXIT_FAILURE;
+      }
+      mpu6050_int_enable(&mpu);
+      use_drdy = 1;
+   }
+   else if (aux_mag && sim)
+   {
+      drdy_open_timer(&drdy, 1000000); /* stand-in for the simulated 1kHz interrupt */
+      use_drdy = 1;
+   }
+
+   mpu6050_sample_t samples[MPU6050_FIFO_SIZE / MPU6050_FIFO_SAMPLE_SIZE];
    while (1)
    {
-      mpu6050_read(&mpu);
+      if (use_drdy)
+      {
+         drdy_wait(&drdy, 100);
+      }
+      else
+      {
+         sleep_ms(aux_mag ? 1 : 20); /* the FIFO holds 85ms of data */
+      }
+      if (aux_mag)
+      {
+         /* accelerometer, temperature, gyroscope and magnetometer in one transaction: */
+         if (mpu6050_read(&mpu) == 0)
+         {
+            hmc5883_parse(&hmc);
+         }
+      }
+      else
+      {
+         ret = mpu6050_fifo_read(&mpu, samples, sizeof(samples) / sizeof(samples[0]));
+         if (ret == -EOVERFLOW)
+         {
+            printf("MPU6050 FIFO overflow\n");
+         }
+      }
    }
    return 0;
 }
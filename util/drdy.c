@@ -0,0 +1,179 @@
+
+/*
+   data-ready interrupt implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "drdy.h"
+
+
+/* configures the edge of a sysfs GPIO, given the path of its value file: */
+static void gpio_set_edge(const char *value_path)
+{
+   char path[256];
+   size_t len = strlen(value_path);
+   if (len < 5 || len - 5 + 4 >= sizeof(path))
+   {
+      return;
+   }
+   memcpy(path, value_path, len - 5);
+   strcpy(path + len - 5, "edge");
+   FILE *file = fopen(path, "w");
+   if (file != NULL)
+   {
+      fputs("rising", file); /* may fail if already configured, e.g. by the kernel */
+      fclose(file);
+   }
+}
+
+
+int drdy_open(drdy_t *drdy, const char *path)
+{
+   size_t len = strlen(path);
+   int gpio = len >= 5 && strcmp(path + len - 5, "value") == 0;
+   if (gpio)
+   {
+      gpio_set_edge(path);
+   }
+   drdy->fd = open(path, O_RDONLY | O_NONBLOCK);
+   if (drdy->fd < 0)
+   {
+      return -errno;
+   }
+   if (gpio)
+   {
+      /* consume the initial state, sysfs reports it as an event: */
+      char buf[8];
+      read(drdy->fd, buf, sizeof(buf));
+      drdy->type = DRDY_GPIO;
+   }
+   else
+   {
+      drdy->type = DRDY_CHARDEV;
+   }
+   return 0;
+}
+
+
+int drdy_open_eventfd(drdy_t *drdy)
+{
+   drdy->fd = eventfd(0, EFD_NONBLOCK);
+   if (drdy->fd < 0)
+   {
+      return -errno;
+   }
+   drdy->type = DRDY_COUNTER;
+   return 0;
+}
+
+
+int drdy_open_timer(drdy_t *drdy, uint64_t period_ns)
+{
+   drdy->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+   if (drdy->fd < 0)
+   {
+      return -errno;
+   }
+   struct itimerspec spec;
+   spec.it_interval.tv_sec = period_ns / 1000000000;
+   spec.it_interval.tv_nsec = period_ns % 1000000000;
+   spec.it_value = spec.it_interval;
+   if (timerfd_settime(drdy->fd, 0, &spec, NULL) < 0)
+   {
+      int ret = -errno;
+      close(drdy->fd);
+      return ret;
+   }
+   drdy->type = DRDY_COUNTER;
+   return 0;
+}
+
+
+int drdy_signal(drdy_t *drdy)
+{
+   uint64_t one = 1;
+   if (write(drdy->fd, &one, sizeof(one)) != sizeof(one))
+   {
+      return -errno;
+   }
+   return 0;
+}
+
+
+int drdy_wait(drdy_t *drdy, int timeout_ms)
+{
+   struct pollfd pfd;
+   pfd.fd = drdy->fd;
+   pfd.events = drdy->type == DRDY_GPIO ? (POLLPRI | POLLERR) : POLLIN;
+   int ret = poll(&pfd, 1, timeout_ms);
+   if (ret < 0)
+   {
+      return errno == EINTR ? 0 : -errno;
+   }
+   if (ret == 0)
+   {
+      return 0;
+   }
+
+   /* acknowledge the event: */
+   switch (drdy->type)
+   {
+      case DRDY_GPIO:
+      {
+         char buf[8];
+         lseek(drdy->fd, 0, SEEK_SET);
+         read(drdy->fd, buf, sizeof(buf));
+         return 1;
+      }
+
+      case DRDY_CHARDEV:
+      {
+         char buf[64];
+         if (read(drdy->fd, buf, sizeof(buf)) < 0 && errno != EAGAIN)
+         {
+            return -errno;
+         }
+         return 1;
+      }
+
+      default:
+      {
+         uint64_t count;
+         if (read(drdy->fd, &count, sizeof(count)) != sizeof(count))
+         {
+            return errno == EAGAIN ? 0 : -errno;
+         }
+         return count > INT_MAX ? INT_MAX : (int)count;
+      }
+   }
+}
+
+
+void drdy_close(drdy_t *drdy)
+{
+   close(drdy->fd);
+   drdy->fd = -1;
+}
+
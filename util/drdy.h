@@ -0,0 +1,68 @@
+
+/*
+   data-ready interrupt interface
+
+   Waits for the data-ready signal of a sensor, delivered through
+   a sysfs GPIO value file, an event character device or, for testing,
+   an eventfd or timerfd stand-in.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __DRDY_H__
+#define __DRDY_H__
+
+
+#include <stdint.h>
+
+
+typedef enum
+{
+   DRDY_GPIO, /* sysfs GPIO value file, signals edges with POLLPRI */
+   DRDY_CHARDEV, /* character device, one readable event per interrupt */
+   DRDY_COUNTER /* eventfd or timerfd, read returns the number of events */
+}
+drdy_type_t;
+
+
+typedef struct
+{
+   drdy_type_t type;
+   int fd;
+}
+drdy_t;
+
+
+/* opens a GPIO value file (path ending in "value", the edge is set to rising)
+   or an event character device */
+int drdy_open(drdy_t *drdy, const char *path);
+
+/* opens an eventfd, triggered by drdy_signal() */
+int drdy_open_eventfd(drdy_t *drdy);
+
+/* opens a timer firing every period_ns, standing in for a sensor's data-ready line */
+int drdy_open_timer(drdy_t *drdy, uint64_t period_ns);
+
+/* signals an eventfd */
+int drdy_signal(drdy_t *drdy);
+
+/* waits for data-ready; returns the number of events since the last call (>= 1),
+   0 on timeout or a negative error code; a negative timeout blocks indefinitely */
+int drdy_wait(drdy_t *drdy, int timeout_ms);
+
+void drdy_close(drdy_t *drdy);
+
+
+#endif /* __DRDY_H__ */
+
@@ -52,3 +52,28 @@ void sleep_ms(uint32_t msec)
    nanosleep(&tim , &tim2);
 }
 
+
+void sleep_ns(uint64_t nsec)
+{
+   struct timespec tim;
+   tim.tv_sec = nsec / 1000000000;
+   tim.tv_nsec = nsec % 1000000000;
+   nanosleep(&tim, NULL);
+}
+
+
+uint64_t monotonic_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+uint64_t monotonic_raw_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
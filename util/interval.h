@@ -21,6 +21,7 @@
 #define __INTERVAL_H__
 
 
+#include <stdint.h>
 #include <time.h>
 
 
@@ -38,6 +39,15 @@ float interval_measure(interval_t *interval);
 
 void sleep_ms(uint32_t msec);
 
+void sleep_ns(uint64_t nsec);
+
+/* returns monotonic clock time in ns: */
+uint64_t monotonic_ns(void);
+
+/* returns raw hardware clock time in ns, not slewed by NTP;
+   used for sample timestamps: */
+uint64_t monotonic_raw_ns(void);
+
 
 #endif /* __INTERVAL_H__ */
 
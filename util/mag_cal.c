@@ -0,0 +1,401 @@
+
+/*
+   Online Magnetometer Calibration Implementation
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "mag_cal.h"
+#include "interval.h"
+
+
+/* minimum effective number of samples for a fit: */
+#define MIN_WEIGHT 100.0
+
+/* relative pivot below which the samples do not determine the ellipsoid: */
+#define MIN_PIVOT 1.0e-9
+
+/* maximum ratio of the ellipsoid radii, larger ratios indicate a bad fit: */
+#define MAX_RADIUS_RATIO 2.0
+
+
+
+void mag_cal_pub_init(mag_cal_pub_t *pub)
+{
+   memset(pub, 0, sizeof(mag_cal_pub_t));
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      pub->params.matrix[i][i] = 1.0f;
+   }
+}
+
+
+void mag_cal_publish(mag_cal_pub_t *pub, const mag_cal_params_t *params)
+{
+   unsigned int seq = __atomic_load_n(&pub->seq, __ATOMIC_RELAXED);
+   __atomic_store_n(&pub->seq, seq + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   pub->params = *params;
+   __atomic_store_n(&pub->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+void mag_cal_get(mag_cal_pub_t *pub, mag_cal_params_t *params)
+{
+   unsigned int seq;
+   do
+   {
+      seq = __atomic_load_n(&pub->seq, __ATOMIC_ACQUIRE);
+      *params = pub->params;
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   }
+   while ((seq & 1) || seq != __atomic_load_n(&pub->seq, __ATOMIC_RELAXED));
+}
+
+
+void mag_cal_apply(const mag_cal_params_t *params, vec3_t *out, const vec3_t *raw)
+{
+   float d[3];
+   int i;
+   for (i = 0; i < 3; i++)
+   {
+      d[i] = raw->vec[i] - params->offset.vec[i];
+   }
+   for (i = 0; i < 3; i++)
+   {
+      out->vec[i] = params->matrix[i][0] * d[0] + params->matrix[i][1] * d[1] + params->matrix[i][2] * d[2];
+   }
+}
+
+
+
+void mag_cal_init(mag_cal_t *cal, unsigned int window)
+{
+   memset(cal->dtd, 0, sizeof(cal->dtd));
+   memset(cal->dt1, 0, sizeof(cal->dt1));
+   cal->weight = 0.0;
+   cal->decay = window > 0 ? 1.0 - 1.0 / window : 1.0;
+   cal->scale = 0.0;
+   cal->running = 0;
+   pthread_mutex_init(&cal->mutex, NULL);
+}
+
+
+void mag_cal_add(mag_cal_t *cal, const vec3_t *raw)
+{
+   pthread_mutex_lock(&cal->mutex);
+   if (cal->scale == 0.0)
+   {
+      double norm = sqrt(raw->x * raw->x + raw->y * raw->y + raw->z * raw->z);
+      if (norm == 0.0)
+      {
+         goto out;
+      }
+      cal->scale = 1.0 / norm;
+   }
+
+   /* design row of x'Mx + 2v'x = 1: */
+   double x = raw->x * cal->scale;
+   double y = raw->y * cal->scale;
+   double z = raw->z * cal->scale;
+   double d[MAG_CAL_PARAMS] = {x * x, y * y, z * z, 2.0 * y * z, 2.0 * x * z, 2.0 * x * y, 2.0 * x, 2.0 * y, 2.0 * z};
+   int i, j;
+   for (i = 0; i < MAG_CAL_PARAMS; i++)
+   {
+      for (j = i; j < MAG_CAL_PARAMS; j++)
+      {
+         cal->dtd[i][j] = cal->decay * cal->dtd[i][j] + d[i] * d[j];
+      }
+      cal->dt1[i] = cal->decay * cal->dt1[i] + d[i];
+   }
+   cal->weight = cal->decay * cal->weight + 1.0;
+
+out:
+   pthread_mutex_unlock(&cal->mutex);
+}
+
+
+/* solves a * x = b for symmetric positive definite a (upper triangle) in place;
+   returns -EDOM if a is not sufficiently positive definite: */
+static int cholesky_solve(double a[MAG_CAL_PARAMS][MAG_CAL_PARAMS], double *b)
+{
+   const int n = MAG_CAL_PARAMS;
+   double l[MAG_CAL_PARAMS][MAG_CAL_PARAMS];
+   double max_diag = 0.0;
+   int i, j, k;
+   for (i = 0; i < n; i++)
+   {
+      max_diag = a[i][i] > max_diag ? a[i][i] : max_diag;
+   }
+   for (j = 0; j < n; j++)
+   {
+      double sum = a[j][j];
+      for (k = 0; k < j; k++)
+      {
+         sum -= l[j][k] * l[j][k];
+      }
+      if (sum <= MIN_PIVOT * max_diag)
+      {
+         return -EDOM;
+      }
+      l[j][j] = sqrt(sum);
+      for (i = j + 1; i < n; i++)
+      {
+         sum = a[j][i];
+         for (k = 0; k < j; k++)
+         {
+            sum -= l[i][k] * l[j][k];
+         }
+         l[i][j] = sum / l[j][j];
+      }
+   }
+
+   /* forward and back substitution: */
+   for (i = 0; i < n; i++)
+   {
+      for (k = 0; k < i; k++)
+      {
+         b[i] -= l[i][k] * b[k];
+      }
+      b[i] /= l[i][i];
+   }
+   for (i = n - 1; i >= 0; i--)
+   {
+      for (k = i + 1; k < n; k++)
+      {
+         b[i] -= l[k][i] * b[k];
+      }
+      b[i] /= l[i][i];
+   }
+   return 0;
+}
+
+
+/* eigen decomposition of a symmetric 3x3 matrix by Jacobi rotations,
+   a = v * diag(e) * v': */
+static void sym_eigen3(double a[3][3], double e[3], double v[3][3])
+{
+   int i, j, k, sweep;
+   for (i = 0; i < 3; i++)
+   {
+      for (j = 0; j < 3; j++)
+      {
+         v[i][j] = i == j ? 1.0 : 0.0;
+      }
+   }
+   for (sweep = 0; sweep < 50; sweep++)
+   {
+      double off = fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]);
+      if (off < 1.0e-15 * (fabs(a[0][0]) + fabs(a[1][1]) + fabs(a[2][2])))
+      {
+         break;
+      }
+      int p, q;
+      for (p = 0; p < 2; p++)
+      {
+         for (q = p + 1; q < 3; q++)
+         {
+            if (a[p][q] == 0.0)
+            {
+               continue;
+            }
+            double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+            double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+            double c = 1.0 / sqrt(t * t + 1.0);
+            double s = t * c;
+            for (k = 0; k < 3; k++)
+            {
+               double akp = a[k][p];
+               double akq = a[k][q];
+               a[k][p] = c * akp - s * akq;
+               a[k][q] = s * akp + c * akq;
+            }
+            for (k = 0; k < 3; k++)
+            {
+               double apk = a[p][k];
+               double aqk = a[q][k];
+               a[p][k] = c * apk - s * aqk;
+               a[q][k] = s * apk + c * aqk;
+            }
+            for (k = 0; k < 3; k++)
+            {
+               double vkp = v[k][p];
+               double vkq = v[k][q];
+               v[k][p] = c * vkp - s * vkq;
+               v[k][q] = s * vkp + c * vkq;
+            }
+         }
+      }
+   }
+   for (i = 0; i < 3; i++)
+   {
+      e[i] = a[i][i];
+   }
+}
+
+
+int mag_cal_solve(mag_cal_t *cal, mag_cal_params_t *params)
+{
+   double dtd[MAG_CAL_PARAMS][MAG_CAL_PARAMS];
+   double theta[MAG_CAL_PARAMS];
+
+   /* snapshot the statistics, the solution runs unlocked: */
+   pthread_mutex_lock(&cal->mutex);
+   memcpy(dtd, cal->dtd, sizeof(dtd));
+   memcpy(theta, cal->dt1, sizeof(theta));
+   double weight = cal->weight;
+   double scale = cal->scale;
+   pthread_mutex_unlock(&cal->mutex);
+   if (weight < MIN_WEIGHT)
+   {
+      return -EAGAIN;
+   }
+
+   /* least squares fit of the ellipsoid parameters: */
+   if (cholesky_solve(dtd, theta) < 0)
+   {
+      return -EDOM;
+   }
+   double m[3][3] =
+   {
+      {theta[0], theta[5], theta[4]},
+      {theta[5], theta[1], theta[3]},
+      {theta[4], theta[3], theta[2]}
+   };
+   double v[3] = {theta[6], theta[7], theta[8]};
+
+   /* center c = -inv(M) * v: */
+   double cof[3][3];
+   int i, j, k;
+   for (i = 0; i < 3; i++)
+   {
+      for (j = 0; j < 3; j++)
+      {
+         int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+         int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+         cof[j][i] = m[i1][j1] * m[i2][j2] - m[i1][j2] * m[i2][j1];
+      }
+   }
+   double det = m[0][0] * cof[0][0] + m[0][1] * cof[1][0] + m[0][2] * cof[2][0];
+   if (det <= 0.0)
+   {
+      return -EDOM;
+   }
+   double c[3];
+   for (i = 0; i < 3; i++)
+   {
+      c[i] = -(cof[i][0] * v[0] + cof[i][1] * v[1] + cof[i][2] * v[2]) / det;
+   }
+
+   /* normalized shape (y'Ay = 1 for y = x - c): */
+   double k_norm = 1.0;
+   for (i = 0; i < 3; i++)
+   {
+      for (j = 0; j < 3; j++)
+      {
+         k_norm += c[i] * m[i][j] * c[j];
+      }
+   }
+   double a[3][3];
+   for (i = 0; i < 3; i++)
+   {
+      for (j = 0; j < 3; j++)
+      {
+         a[i][j] = m[i][j] / k_norm;
+      }
+   }
+
+   /* the square root of A maps the ellipsoid to the unit sphere,
+      rescaled to the mean radius to keep the units of the raw data: */
+   double e[3], vec[3][3];
+   sym_eigen3(a, e, vec);
+   double r_min = INFINITY, r_max = 0.0, r_prod = 1.0;
+   for (i = 0; i < 3; i++)
+   {
+      if (e[i] <= 0.0)
+      {
+         return -EDOM;
+      }
+      double r = 1.0 / sqrt(e[i]);
+      r_min = r < r_min ? r : r_min;
+      r_max = r > r_max ? r : r_max;
+      r_prod *= r;
+   }
+   if (r_max > MAX_RADIUS_RATIO * r_min)
+   {
+      return -EDOM;
+   }
+   double r_mean = cbrt(r_prod);
+   for (i = 0; i < 3; i++)
+   {
+      params->offset.vec[i] = c[i] / scale;
+      for (j = 0; j < 3; j++)
+      {
+         double sum = 0.0;
+         for (k = 0; k < 3; k++)
+         {
+            sum += vec[i][k] * sqrt(e[k]) * vec[j][k];
+         }
+         params->matrix[i][j] = sum * r_mean;
+      }
+   }
+   return 0;
+}
+
+
+static void *solver(void *arg)
+{
+   mag_cal_t *cal = (mag_cal_t *)arg;
+   while (cal->running)
+   {
+      sleep_ms(cal->period_ms);
+      mag_cal_params_t params;
+      if (mag_cal_solve(cal, &params) == 0)
+      {
+         mag_cal_publish(cal->pub, &params);
+      }
+   }
+   return NULL;
+}
+
+
+int mag_cal_start(mag_cal_t *cal, mag_cal_pub_t *pub, unsigned int period_ms)
+{
+   cal->pub = pub;
+   cal->period_ms = period_ms;
+   cal->running = 1;
+   int ret = pthread_create(&cal->thread, NULL, solver, cal);
+   if (ret != 0)
+   {
+      cal->running = 0;
+      return -ret;
+   }
+   return 0;
+}
+
+
+void mag_cal_stop(mag_cal_t *cal)
+{
+   if (cal->running)
+   {
+      cal->running = 0;
+      pthread_join(cal->thread, NULL);
+   }
+}
+
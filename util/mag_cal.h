@@ -0,0 +1,104 @@
+
+/*
+   Online Magnetometer Calibration Interface
+
+   Fits an ellipsoid to the raw magnetometer samples, correcting
+   hard-iron (offset) and soft-iron (matrix) distortions. Samples
+   update fixed-size sufficient statistics in constant time; a
+   background thread periodically solves the fit and publishes
+   the result through a sequence lock, which the driver reads
+   without blocking.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __MAG_CAL_H__
+#define __MAG_CAL_H__
+
+
+#include <pthread.h>
+
+#include "math.h"
+
+
+/* number of ellipsoid parameters: */
+#define MAG_CAL_PARAMS 9
+
+
+/* calibrated = matrix * (raw - offset): */
+typedef struct
+{
+   vec3_t offset;
+   float matrix[3][3];
+}
+mag_cal_params_t;
+
+
+/* published calibration, single writer, any number of readers: */
+typedef struct
+{
+   unsigned int seq; /* odd while an update is in progress */
+   mag_cal_params_t params;
+}
+mag_cal_pub_t;
+
+
+typedef struct
+{
+   /* sufficient statistics, upper triangle of D'D and D'1: */
+   pthread_mutex_t mutex;
+   double dtd[MAG_CAL_PARAMS][MAG_CAL_PARAMS];
+   double dt1[MAG_CAL_PARAMS];
+   double weight; /* effective number of samples */
+   double decay; /* forgetting factor per sample */
+   double scale; /* input scaling for conditioning, from the first sample */
+
+   /* solver thread: */
+   pthread_t thread;
+   volatile int running;
+   mag_cal_pub_t *pub;
+   unsigned int period_ms;
+}
+mag_cal_t;
+
+
+/* initializes the publication to the identity calibration */
+void mag_cal_pub_init(mag_cal_pub_t *pub);
+
+void mag_cal_publish(mag_cal_pub_t *pub, const mag_cal_params_t *params);
+
+/* reads a consistent copy of the published calibration */
+void mag_cal_get(mag_cal_pub_t *pub, mag_cal_params_t *params);
+
+void mag_cal_apply(const mag_cal_params_t *params, vec3_t *out, const vec3_t *raw);
+
+
+/* window: number of samples after which old samples are weighted by 1/e */
+void mag_cal_init(mag_cal_t *cal, unsigned int window);
+
+/* adds a raw sample in constant time */
+void mag_cal_add(mag_cal_t *cal, const vec3_t *raw);
+
+/* fits the ellipsoid to the samples so far; returns 0, -EAGAIN if there are
+   too few samples or -EDOM if they do not cover enough directions */
+int mag_cal_solve(mag_cal_t *cal, mag_cal_params_t *params);
+
+/* starts a thread publishing each successful fit every period_ms */
+int mag_cal_start(mag_cal_t *cal, mag_cal_pub_t *pub, unsigned int period_ms);
+
+void mag_cal_stop(mag_cal_t *cal);
+
+
+#endif /* __MAG_CAL_H__ */
+
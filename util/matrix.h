@@ -0,0 +1,75 @@
+
+/*
+   Small Matrix Interface
+
+   Header-only, fixed size matrices and vectors of doubles for 2, 3, 4
+   and 6 dimensions. Each size has its own types and functions, e.g.
+   mat3x3_t, vec3d_t and mat3x3_mul(), generated from matrix_template.h;
+   the loops have constant bounds and are unrolled by the compiler.
+
+   All functions allow the output to alias any input.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#ifndef __MATRIX_H__
+#define __MATRIX_H__
+
+
+#include <errno.h>
+#include <math.h>
+
+
+#define MATRIX_INLINE static inline __attribute__((always_inline))
+
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+#define MATRIX_UNROLL _Pragma("GCC unroll 8")
+#else
+#define MATRIX_UNROLL
+#endif
+
+
+/* the 3d vector also has named components: */
+typedef union
+{
+   struct
+   {
+      double x;
+      double y;
+      double z;
+   };
+   double data[3];
+}
+vec3d_t;
+
+
+#define MAT_N 2
+#include "matrix_template.h"
+#undef MAT_N
+
+#define MAT_N 3
+#include "matrix_template.h"
+#undef MAT_N
+
+#define MAT_N 4
+#include "matrix_template.h"
+#undef MAT_N
+
+#define MAT_N 6
+#include "matrix_template.h"
+#undef MAT_N
+
+
+#endif /* __MATRIX_H__ */
+
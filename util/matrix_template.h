@@ -0,0 +1,420 @@
+
+/*
+   Small Matrix Functions
+
+   Included by matrix.h once per size, with MAT_N the number of rows
+   and columns. The results are computed into a local and copied out
+   at the end wherever an input element is read after its output
+   element was written, so outputs may alias inputs.
+
+   Copyright (C) 2012 Tobias Simon
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+*/
+
+
+#define MAT_PASTE3(a, b, c) a ## b ## c
+#define MAT_NAME(a, b, c) MAT_PASTE3(a, b, c)
+#define MAT_T MAT_NAME(mat, MAT_N, MAT_NAME(x, MAT_N, _t))
+#define VEC_T MAT_NAME(vec, MAT_N, d_t)
+#define MAT_FN(name) MAT_NAME(mat, MAT_N, MAT_NAME(x, MAT_N, _ ## name))
+#define VEC_FN(name) MAT_NAME(vec, MAT_N, d_ ## name)
+
+
+typedef struct
+{
+   double data[MAT_N][MAT_N];
+}
+MAT_T;
+
+
+#if MAT_N != 3
+typedef struct
+{
+   double data[MAT_N];
+}
+VEC_T;
+#endif
+
+
+/* vector operations: */
+
+MATRIX_INLINE void VEC_FN(add)(VEC_T *out, const VEC_T *a, const VEC_T *b)
+{
+   int i;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      out->data[i] = a->data[i] + b->data[i];
+   }
+}
+
+
+MATRIX_INLINE void VEC_FN(sub)(VEC_T *out, const VEC_T *a, const VEC_T *b)
+{
+   int i;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      out->data[i] = a->data[i] - b->data[i];
+   }
+}
+
+
+/* element-wise product: */
+MATRIX_INLINE void VEC_FN(mul)(VEC_T *out, const VEC_T *a, const VEC_T *b)
+{
+   int i;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      out->data[i] = a->data[i] * b->data[i];
+   }
+}
+
+
+MATRIX_INLINE void VEC_FN(scale)(VEC_T *out, double s, const VEC_T *a)
+{
+   int i;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      out->data[i] = s * a->data[i];
+   }
+}
+
+
+MATRIX_INLINE double VEC_FN(dot)(const VEC_T *a, const VEC_T *b)
+{
+   double sum = 0.0;
+   int i;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      sum += a->data[i] * b->data[i];
+   }
+   return sum;
+}
+
+
+/* matrix operations: */
+
+MATRIX_INLINE void MAT_FN(zero)(MAT_T *out)
+{
+   int i, j;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      MATRIX_UNROLL
+      for (j = 0; j < MAT_N; j++)
+      {
+         out->data[i][j] = 0.0;
+      }
+   }
+}
+
+
+MATRIX_INLINE void MAT_FN(identity)(MAT_T *out)
+{
+   int i, j;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      MATRIX_UNROLL
+      for (j = 0; j < MAT_N; j++)
+      {
+         out->data[i][j] = i == j ? 1.0 : 0.0;
+      }
+   }
+}
+
+
+MATRIX_INLINE void MAT_FN(add)(MAT_T *out, const MAT_T *a, const MAT_T *b)
+{
+   int i, j;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      MATRIX_UNROLL
+      for (j = 0; j < MAT_N; j++)
+      {
+         out->data[i][j] = a->data[i][j] + b->data[i][j];
+      }
+   }
+}
+
+
+MATRIX_INLINE void MAT_FN(sub)(MAT_T *out, const MAT_T *a, const MAT_T *b)
+{
+   int i, j;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      MATRIX_UNROLL
+      for (j = 0; j < MAT_N; j++)
+      {
+         out->data[i][j] = a->data[i][j] - b->data[i][j];
+      }
+   }
+}
+
+
+MATRIX_INLINE void MAT_FN(scale)(MAT_T *out, double s, const MAT_T *a)
+{
+   int i, j;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      MATRIX_UNROLL
+      for (j = 0; j < MAT_N; j++)
+      {
+         out->data[i][j] = s * a->data[i][j];
+      }
+   }
+}
+
+
+MATRIX_INLINE void MAT_FN(trans)(MAT_T *out, const MAT_T *a)
+{
+   MAT_T t;
+   int i, j;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      MATRIX_UNROLL
+      for (j = 0; j < MAT_N; j++)
+      {
+         t.data[i][j] = a->data[j][i];
+      }
+   }
+   *out = t;
+}
+
+
+/* out = a * b: */
+MATRIX_INLINE void MAT_FN(mul)(MAT_T *out, const MAT_T *a, const MAT_T *b)
+{
+   MAT_T t;
+   int i, j, k;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      MATRIX_UNROLL
+      for (j = 0; j < MAT_N; j++)
+      {
+         double sum = 0.0;
+         MATRIX_UNROLL
+         for (k = 0; k < MAT_N; k++)
+         {
+            sum += a->data[i][k] * b->data[k][j];
+         }
+         t.data[i][j] = sum;
+      }
+   }
+   *out = t;
+}
+
+
+/* out = a * b^T: */
+MATRIX_INLINE void MAT_FN(mul_trans)(MAT_T *out, const MAT_T *a, const MAT_T *b)
+{
+   MAT_T t;
+   int i, j, k;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      MATRIX_UNROLL
+      for (j = 0; j < MAT_N; j++)
+      {
+         double sum = 0.0;
+         MATRIX_UNROLL
+         for (k = 0; k < MAT_N; k++)
+         {
+            sum += a->data[i][k] * b->data[j][k];
+         }
+         t.data[i][j] = sum;
+      }
+   }
+   *out = t;
+}
+
+
+/* out = a * v: */
+MATRIX_INLINE void MAT_FN(mul_vec)(VEC_T *out, const MAT_T *a, const VEC_T *v)
+{
+   VEC_T t;
+   int i, k;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      double sum = 0.0;
+      MATRIX_UNROLL
+      for (k = 0; k < MAT_N; k++)
+      {
+         sum += a->data[i][k] * v->data[k];
+      }
+      t.data[i] = sum;
+   }
+   *out = t;
+}
+
+
+/* cholesky factorization a = l * l^T of a symmetric positive definite matrix,
+   only the lower triangle of a is read, l is lower triangular;
+   returns 0 or -EDOM if a is not positive definite */
+MATRIX_INLINE int MAT_FN(chol)(MAT_T *l, const MAT_T *a)
+{
+   MAT_T t;
+   int i, j, k;
+   MATRIX_UNROLL
+   for (j = 0; j < MAT_N; j++)
+   {
+      double d = a->data[j][j];
+      MATRIX_UNROLL
+      for (k = 0; k < j; k++)
+      {
+         d -= t.data[j][k] * t.data[j][k];
+      }
+      if (!(d > 0.0))
+      {
+         return -EDOM;
+      }
+      d = sqrt(d);
+      t.data[j][j] = d;
+      MATRIX_UNROLL
+      for (i = j + 1; i < MAT_N; i++)
+      {
+         double sum = a->data[i][j];
+         MATRIX_UNROLL
+         for (k = 0; k < j; k++)
+         {
+            sum -= t.data[i][k] * t.data[j][k];
+         }
+         t.data[i][j] = sum / d;
+         t.data[j][i] = 0.0;
+      }
+   }
+   *l = t;
+   return 0;
+}
+
+
+/* solves l * l^T * x = b with l from chol: */
+MATRIX_INLINE void MAT_FN(chol_solve)(VEC_T *x, const MAT_T *l, const VEC_T *b)
+{
+   VEC_T y;
+   int i, k;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      double sum = b->data[i];
+      MATRIX_UNROLL
+      for (k = 0; k < i; k++)
+      {
+         sum -= l->data[i][k] * y.data[k];
+      }
+      y.data[i] = sum / l->data[i][i];
+   }
+   MATRIX_UNROLL
+   for (i = MAT_N - 1; i >= 0; i--)
+   {
+      double sum = y.data[i];
+      MATRIX_UNROLL
+      for (k = i + 1; k < MAT_N; k++)
+      {
+         sum -= l->data[k][i] * y.data[k];
+      }
+      y.data[i] = sum / l->data[i][i];
+   }
+   *x = y;
+}
+
+
+/* factorization a = l * diag(d) * l^T of a symmetric matrix without square roots,
+   only the lower triangle of a is read, l is unit lower triangular;
+   returns 0 or -EDOM for a zero pivot */
+MATRIX_INLINE int MAT_FN(ldl)(MAT_T *l, VEC_T *d, const MAT_T *a)
+{
+   MAT_T t;
+   VEC_T e;
+   int i, j, k;
+   MATRIX_UNROLL
+   for (j = 0; j < MAT_N; j++)
+   {
+      double dj = a->data[j][j];
+      MATRIX_UNROLL
+      for (k = 0; k < j; k++)
+      {
+         dj -= t.data[j][k] * t.data[j][k] * e.data[k];
+      }
+      if (dj == 0.0)
+      {
+         return -EDOM;
+      }
+      e.data[j] = dj;
+      t.data[j][j] = 1.0;
+      MATRIX_UNROLL
+      for (i = j + 1; i < MAT_N; i++)
+      {
+         double sum = a->data[i][j];
+         MATRIX_UNROLL
+         for (k = 0; k < j; k++)
+         {
+            sum -= t.data[i][k] * t.data[j][k] * e.data[k];
+         }
+         t.data[i][j] = sum / dj;
+         t.data[j][i] = 0.0;
+      }
+   }
+   *l = t;
+   *d = e;
+   return 0;
+}
+
+
+/* solves l * diag(d) * l^T * x = b with l and d from ldl: */
+MATRIX_INLINE void MAT_FN(ldl_solve)(VEC_T *x, const MAT_T *l, const VEC_T *d, const VEC_T *b)
+{
+   VEC_T y;
+   int i, k;
+   MATRIX_UNROLL
+   for (i = 0; i < MAT_N; i++)
+   {
+      double sum = b->data[i];
+      MATRIX_UNROLL
+      for (k = 0; k < i; k++)
+      {
+         sum -= l->data[i][k] * y.data[k];
+      }
+      y.data[i] = sum;
+   }
+   MATRIX_UNROLL
+   for (i = MAT_N - 1; i >= 0; i--)
+   {
+      double sum = y.data[i] / d->data[i];
+      MATRIX_UNROLL
+      for (k = i + 1; k < MAT_N; k++)
+      {
+         sum -= l->data[k][i] * y.data[k];
+      }
+      y.data[i] = sum;
+   }
+   *x = y;
+}
+
+
+#undef MAT_T
+#undef VEC_T
+#undef MAT_FN
+#undef VEC_FN
+#undef MAT_NAME
+#undef MAT_PASTE3
+